@@ -54,7 +54,17 @@ typedef enum { TWIN_A8, TWIN_RGB16, TWIN_ARGB32 } twin_format_t;
  */
 
 #define TWIN_FEATURE_ALTIVEC	0x00000001
+#define TWIN_FEATURE_SSE2	0x00000002
+#define TWIN_FEATURE_SSSE3	0x00000004
+#define TWIN_FEATURE_SSE41	0x00000008
+#define TWIN_FEATURE_AVX2	0x00000010
+#define TWIN_FEATURE_VECTOR	0x00000020
 
+/*
+ * Setting TWIN_FEATURES in the environment to one of c, vector,
+ * altivec, sse2, ssse3, sse4.1 or avx2 limits twin_feature_init to that tier;
+ * any other value is reported on stderr and treated as c
+ */
 void twin_feature_init(void);
 int twin_has_feature(unsigned int feature);
 
@@ -83,6 +93,17 @@ typedef struct _twin_rect {
     twin_coord_t    left, right, top, bottom;
 } twin_rect_t;
 
+/*
+ * A region - a short list of disjoint rectangles
+ */
+#define TWIN_REGION_RECTS   8
+
+typedef struct _twin_region {
+    twin_count_t    nrects;
+    twin_rect_t	    extents;
+    twin_rect_t	    rects[TWIN_REGION_RECTS];
+} twin_region_t;
+
 /*
  * Place matrices in structures so they can be easily copied
  */
@@ -100,6 +121,8 @@ typedef union _twin_pointer {
 
 typedef struct _twin_window twin_window_t;
 typedef struct _twin_screen twin_screen_t;
+typedef struct _twin_screen_threads twin_screen_threads_t;
+typedef struct _twin_grid twin_grid_t;
 
 /*
  * Events
@@ -162,6 +185,33 @@ typedef struct _twin_event_queue {
     twin_event_t		event;
 } twin_event_queue_t;
 
+/*
+ * How a transformed pixmap is sampled
+ */
+typedef enum { TWIN_FILTER_NEAREST, TWIN_FILTER_BILINEAR } twin_filter_t;
+
+/*
+ * What a pixmap source shows outside of its clip rectangle
+ */
+typedef enum {
+    TWIN_EXTEND_NONE,	    /* nothing */
+    TWIN_EXTEND_REPEAT,	    /* tiles of the clip */
+    TWIN_EXTEND_PAD,	    /* the nearest edge pixel */
+    TWIN_EXTEND_REFLECT	    /* tiles mirrored every other time */
+} twin_extend_t;
+
+/*
+ * How finely paths drawn into a pixmap are sampled
+ */
+typedef enum {
+    TWIN_ANTIALIAS_NONE,    /* one sample per pixel */
+    TWIN_ANTIALIAS_DEFAULT, /* 4x4 samples */
+    TWIN_ANTIALIAS_BEST,    /* 16x16 samples */
+    TWIN_ANTIALIAS_EXACT    /* exact area coverage; needs an outline
+			       which doesn't overlap itself, others
+			       get 16x16 samples */
+} twin_antialias_t;
+
 /*
  * A rectangular array of pixels
  */
@@ -175,6 +225,7 @@ typedef struct _twin_pixmap {
      * List of displayed pixmaps
      */
     struct _twin_pixmap		*down, *up;
+    twin_count_t		stack;	    /* position, bottom is 0 */
     /*
      * Screen position
      */
@@ -187,6 +238,14 @@ typedef struct _twin_pixmap {
     twin_coord_t		height;	    /* pixels */
     twin_coord_t		stride;	    /* bytes */
     twin_matrix_t		transform;
+    twin_filter_t		filter;
+    twin_extend_t		extend;
+    twin_antialias_t		antialias;
+    /*
+     * Every pixel is opaque, so anything beneath
+     * needn't be painted
+     */
+    twin_bool_t			opaque;
 
     /*
      * Clipping - a single rectangle in pixmap coordinates.
@@ -209,7 +268,7 @@ typedef struct _twin_pixmap {
 } twin_pixmap_t;
 
 /*
- * twin_put_begin_t: called before data are drawn to the screen
+ * twin_put_begin_t: called before each damaged rectangle is drawn
  * twin_put_span_t: called for each scanline drawn
  */
 typedef void	(*twin_put_begin_t) (twin_coord_t left,
@@ -223,6 +282,38 @@ typedef void	(*twin_put_span_t) (twin_coord_t left,
 				    twin_argb32_t *pixels,
 				    void *closure);
 
+/*
+ * twin_get_rect_t: may supply the storage a damaged rectangle is
+ *		    composed into, returning NULL to use a screen buffer
+ * twin_put_rect_t: called with each composed damaged rectangle
+ * twin_put_frame_t: called before and after each screen update
+ * twin_copy_rect_t: moves pixels already on the screen by dx, dy
+ *
+ * Pixels given to these and to twin_put_span_t are in the screen
+ * format; on an RGB16 screen they are twin_rgb16_t whatever the type
+ */
+typedef twin_argb32_t	*(*twin_get_rect_t) (twin_coord_t left,
+					     twin_coord_t top,
+					     twin_coord_t right,
+					     twin_coord_t bottom,
+					     twin_coord_t *stride,
+					     void *closure);
+typedef void	(*twin_put_rect_t) (twin_coord_t left,
+				    twin_coord_t top,
+				    twin_coord_t right,
+				    twin_coord_t bottom,
+				    twin_argb32_t *pixels,
+				    twin_coord_t stride,    /* bytes */
+				    void *closure);
+typedef void	(*twin_put_frame_t) (void *closure);
+typedef void	(*twin_copy_rect_t) (twin_coord_t left,
+				     twin_coord_t top,
+				     twin_coord_t right,
+				     twin_coord_t bottom,
+				     twin_coord_t dx,
+				     twin_coord_t dy,
+				     void *closure);
+
 /*
  * A screen
  */
@@ -232,6 +323,11 @@ struct _twin_screen {
      */
     twin_pixmap_t	*top, *bottom;
 
+    /*
+     * Displayed pixmaps indexed by position
+     */
+    twin_grid_t		*grid;
+
     /*
      * One of them receives all key events
      */
@@ -253,9 +349,22 @@ struct _twin_screen {
     twin_coord_t	curs_y;
 
     /*
-     * Output size
+     * Cursor overlay; with a direct target the cursor is blended
+     * over the composed screen, keeping the pixels beneath it so
+     * that motion needn't recompose anything
+     */
+    twin_bool_t		cursor_overlay;
+    twin_bool_t		cursor_moved;
+    twin_bool_t		cursor_drawn;
+    twin_rect_t		under_rect;
+    twin_argb32_t	*under;
+    twin_area_t		under_size;
+
+    /*
+     * Output size and the format of composed pixels
      */
     twin_coord_t	width, height;
+    twin_format_t	format;
 
     /*
      * Background pattern
@@ -265,18 +374,60 @@ struct _twin_screen {
     /*
      * Damage
      */
-    twin_rect_t		damage;
+    twin_region_t	damage;
     void		(*damaged) (void *);
     void		*damaged_closure;
     twin_count_t	disable;
 
+    /*
+     * A pixmap moved since the last update; its pixels are
+     * shifted on the screen instead of being composed again
+     */
+    twin_pixmap_t	*move_pixmap;
+    twin_coord_t	move_x, move_y;	/* position last update */
+
+    /*
+     * Frame scheduling; damage is collected and the screen
+     * updated at most once every frame_interval ms (-1 when
+     * left to the backend)
+     */
+    twin_time_t		frame_interval;
+    twin_time_t		frame_last;
+    struct _twin_work	*frame_work;
+    struct _twin_timeout	*frame_timeout;
+
     /*
      * Repaint function
      */
     twin_put_begin_t	put_begin;
     twin_put_span_t	put_span;
+    twin_get_rect_t	get_rect;
+    twin_put_rect_t	put_rect;
+    twin_put_frame_t	begin_frame;
+    twin_put_frame_t	end_frame;
+    twin_copy_rect_t	copy_rect;
     void		*closure;
 
+    /*
+     * Direct target; when set, the screen is composed in place
+     * and backends are only told which rectangles changed
+     */
+    twin_argb32_t	*direct;
+    twin_coord_t	direct_stride;	/* bytes */
+    twin_bool_t		direct_shadow;	/* owned by the screen */
+
+    /*
+     * Rectangles are composed here when the backend
+     * doesn't supply storage
+     */
+    twin_argb32_t	*buffer;
+    twin_area_t		buffer_size;
+
+    /*
+     * Threads helping with large updates (optional)
+     */
+    struct _twin_screen_threads	*threads;
+
     /*
      * Window manager stuff
      */
@@ -987,6 +1138,27 @@ twin_pixmap_show (twin_pixmap_t *pixmap,
 		  twin_screen_t	*screen,
 		  twin_pixmap_t *higher);
 
+void
+twin_pixmap_set_opaque (twin_pixmap_t *pixmap, twin_bool_t opaque);
+
+void
+twin_pixmap_set_filter (twin_pixmap_t *pixmap, twin_filter_t filter);
+
+twin_filter_t
+twin_pixmap_get_filter (twin_pixmap_t *pixmap);
+
+void
+twin_pixmap_set_extend (twin_pixmap_t *pixmap, twin_extend_t extend);
+
+twin_extend_t
+twin_pixmap_get_extend (twin_pixmap_t *pixmap);
+
+void
+twin_pixmap_set_antialias (twin_pixmap_t *pixmap, twin_antialias_t antialias);
+
+twin_antialias_t
+twin_pixmap_get_antialias (twin_pixmap_t *pixmap);
+
 void
 twin_pixmap_hide (twin_pixmap_t *pixmap);
 
@@ -1063,6 +1235,45 @@ void
 twin_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
 		twin_coord_t dx, twin_coord_t dy);
 
+/*
+ * twin_region.c
+ */
+
+void
+twin_region_init (twin_region_t *region);
+
+twin_bool_t
+twin_region_is_empty (twin_region_t *region);
+
+void
+twin_region_union_rect (twin_region_t	*region,
+			twin_coord_t	left,	twin_coord_t top,
+			twin_coord_t	right,	twin_coord_t bottom);
+
+twin_bool_t
+twin_region_intersects (twin_region_t	*region,
+			twin_coord_t	left,	twin_coord_t top,
+			twin_coord_t	right,	twin_coord_t bottom);
+
+/*
+ * twin_scratch.c
+ */
+
+/*
+ * Scratch memory held by the calling thread for compositing
+ */
+typedef struct _twin_scratch_stats {
+    size_t		bytes;	    /* currently allocated */
+    unsigned long	grows;	    /* times a buffer was enlarged */
+    unsigned long	uses;	    /* buffers handed out */
+} twin_scratch_stats_t;
+
+void
+twin_scratch_get_stats (twin_scratch_stats_t *stats);
+
+void
+twin_scratch_release (void);
+
 /*
  * twin_screen.c
  */
@@ -1103,6 +1314,46 @@ twin_screen_damaged (twin_screen_t *screen);
 void
 twin_screen_update (twin_screen_t *screen);
 
+void
+twin_screen_set_put_rect (twin_screen_t	*screen,
+			  twin_get_rect_t	get_rect,
+			  twin_put_rect_t	put_rect);
+
+void
+twin_screen_set_put_frame (twin_screen_t	*screen,
+			   twin_put_frame_t	begin_frame,
+			   twin_put_frame_t	end_frame);
+
+void
+twin_screen_set_copy_rect (twin_screen_t	*screen,
+			   twin_copy_rect_t	copy_rect);
+
+void
+twin_screen_set_direct (twin_screen_t	*screen,
+			twin_argb32_t	*pixels,
+			twin_coord_t	stride);
+
+void
+twin_screen_swap_direct (twin_screen_t *screen, twin_argb32_t *pixels);
+
+twin_bool_t
+twin_screen_set_format (twin_screen_t *screen, twin_format_t format);
+
+twin_format_t
+twin_screen_get_format (twin_screen_t *screen);
+
+twin_bool_t
+twin_screen_set_shadow (twin_screen_t *screen, twin_bool_t shadow);
+
+void
+twin_screen_set_frame_interval (twin_screen_t *screen, twin_time_t interval);
+
+void
+twin_screen_set_threads (twin_screen_t *screen, int nthreads);
+
+void
+twin_screen_set_cursor_overlay (twin_screen_t *screen, twin_bool_t overlay);
+
 void
 twin_screen_set_active (twin_screen_t *screen, twin_pixmap_t *pixmap);
 
@@ -0,0 +1,490 @@
+/*
+ * Twin - A Tiny Window System
+ * Copyright © 2004 Keith Packard <keithp@keithp.com>
+ * All rights reserved.
+ *
+ * This Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with the Twin Library; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "twinint.h"
+
+/*
+ * Exact area coverage.  Each edge adds the signed area it sweeps
+ * across a pixel row into an accumulation buffer; the running sum
+ * along the row then holds the coverage of each pixel, so only the
+ * pixels an edge actually crosses cost anything.  Coverage is the
+ * size of that sum, capped at one.  That only follows the non-zero
+ * winding rule while the winding stays within one; contours which
+ * overlap would count the pixels along their edges twice.  So only
+ * paths of a single contour which never crosses itself are filled
+ * here, and the rest are left to the sampled rasterizer.
+ */
+
+typedef struct _twin_area_edges {
+    int			n;
+    twin_fixed_t	*x0, *y0;
+    twin_fixed_t	*x1, *y1;
+    twin_fixed_t	*x;	/* x at the top of the current row */
+    int			*winding;
+} twin_area_edges_t;
+
+static void
+_twin_area_build (twin_spoint_t *vertices, int nvertices,
+		  twin_area_edges_t *edges,
+		  twin_fixed_t dx, twin_fixed_t dy,
+		  twin_fixed_t top_y, twin_fixed_t bot_y)
+{
+    int		    v, nv;
+    int		    tv, bv;
+    int		    e;
+
+    e = edges->n;
+    for (v = 0; v < nvertices; v++)
+    {
+	nv = v + 1;
+	if (nv == nvertices) nv = 0;
+
+	/* skip horizontal edges */
+	if (vertices[v].y == vertices[nv].y)
+	    continue;
+
+	if (vertices[v].y < vertices[nv].y)
+	{
+	    edges->winding[e] = 1;
+	    tv = v;
+	    bv = nv;
+	}
+	else
+	{
+	    edges->winding[e] = -1;
+	    tv = nv;
+	    bv = v;
+	}
+	edges->x0[e] = twin_sfixed_to_fixed (vertices[tv].x) + dx;
+	edges->y0[e] = twin_sfixed_to_fixed (vertices[tv].y) + dy;
+	edges->x1[e] = twin_sfixed_to_fixed (vertices[bv].x) + dx;
+	edges->y1[e] = twin_sfixed_to_fixed (vertices[bv].y) + dy;
+
+	/* skip edges entirely above or below the pixmap */
+	if (edges->y1[e] <= top_y || edges->y0[e] >= bot_y)
+	    continue;
+	e++;
+    }
+    edges->n = e;
+}
+
+static inline twin_fixed_t
+_twin_area_x (twin_area_edges_t *edges, int e, twin_fixed_t y)
+{
+    return edges->x0[e] + (twin_fixed_t)
+	((int64_t) (edges->x1[e] - edges->x0[e]) * (y - edges->y0[e]) /
+	 (edges->y1[e] - edges->y0[e]));
+}
+
+/*
+ * Area of a unit wide ramp left of z
+ */
+static inline int64_t
+_twin_area_ramp (twin_fixed_t z)
+{
+    if (z <= 0)
+	return 0;
+    if (z < TWIN_FIXED_ONE)
+	return ((int64_t) z * z) >> 17;
+    return z - TWIN_FIXED_ONE / 2;
+}
+
+/*
+ * Add the part of a row swept by an edge from xa to xb, d high and
+ * signed by winding, into acc, which holds columns left through
+ * right inclusive.  Anything left of the clip lands on its first
+ * column; nothing past right is needed.
+ */
+static void
+_twin_area_slice (int32_t *acc, twin_coord_t left, twin_coord_t right,
+		  twin_fixed_t xa, twin_fixed_t xb, int32_t d,
+		  twin_coord_t *min_c, twin_coord_t *max_c)
+{
+    twin_fixed_t    a = xa < xb ? xa : xb;
+    twin_fixed_t    b = xa < xb ? xb : xa;
+    twin_coord_t    c0 = twin_fixed_to_int (a);
+    twin_coord_t    c1 = twin_fixed_to_int (twin_fixed_ceil (b));
+    twin_coord_t    c, end;
+    int32_t	    cur, prev;
+    int32_t	    t;
+
+    if (c0 >= right)
+    {
+	/* pixels up to the clip are still inside this edge */
+	*max_c = right;
+	return;
+    }
+    if (c1 <= left)
+    {
+	acc[0] += d;
+	c0 = c1 = left;
+    }
+    else if (c1 - c0 <= 1)
+    {
+	/* one column, split by where the edge crosses it on average */
+	t = (int32_t) (((int64_t) d *
+			((a >> 1) + (b >> 1) - twin_int_to_fixed (c0))) >> 16);
+	acc[c0 - left] += d - t;
+	acc[c0 + 1 - left] += t;
+	c1 = c0 + 1;
+    }
+    else
+    {
+	/* the covered part of each column, accumulated, must reach d */
+	if (c0 < left)
+	    c0 = left;
+	end = c1 < right ? c1 : right;
+	prev = 0;
+	for (c = c0; c <= end; c++)
+	{
+	    if (c == c1)
+		cur = d;
+	    else
+		cur = (int32_t) ((int64_t) d *
+				 (_twin_area_ramp (twin_int_to_fixed (c + 1) - a) -
+				  _twin_area_ramp (twin_int_to_fixed (c + 1) - b)) /
+				 (b - a));
+	    acc[c - left] += cur - prev;
+	    prev = cur;
+	}
+    }
+    if (c0 < *min_c)
+	*min_c = c0;
+    if (c1 > right)
+	c1 = right;
+    if (c1 > *max_c)
+	*max_c = c1;
+}
+
+/*
+ * Turn a row of accumulated area into coverage, adding it to the
+ * pixmap and clearing acc on the way
+ */
+static void
+_twin_area_resolve (twin_pixmap_t *pixmap, twin_extent_t *rows,
+		    twin_coord_t y, int32_t *acc,
+		    twin_coord_t min_c, twin_coord_t max_c)
+{
+    twin_coord_t    left = pixmap->clip.left;
+    twin_coord_t    right = pixmap->clip.right;
+    twin_a8_t	    *span = pixmap->p.a8 + y * pixmap->stride;
+    twin_coord_t    c, l = right, r = left;
+    int32_t	    sum = 0;
+    uint32_t	    v;
+    twin_a16_t	    a;
+
+    for (c = min_c; c <= max_c; c++)
+    {
+	sum += acc[c - left];
+	acc[c - left] = 0;
+	if (c >= right || !sum)
+	    continue;
+	v = sum < 0 ? -sum : sum;
+	if (v > TWIN_FIXED_ONE)
+	    v = TWIN_FIXED_ONE;
+	v = (v * 255 + TWIN_FIXED_HALF) >> 16;
+	if (!v)
+	    continue;
+	a = span[c] + v;
+	span[c] = twin_sat (a);
+	if (c < l)
+	    l = c;
+	r = c + 1;
+    }
+    if (rows && l < r)
+    {
+	twin_extent_t	*e = &rows[y];
+
+	if (e->left >= e->right)
+	{
+	    e->left = l;
+	    e->right = r;
+	}
+	else
+	{
+	    if (l < e->left)
+		e->left = l;
+	    if (r > e->right)
+		e->right = r;
+	}
+    }
+}
+
+static void
+_twin_area_fill (twin_pixmap_t *pixmap, twin_extent_t *rows,
+		 twin_row_func_t row_done, void *closure,
+		 twin_area_edges_t *edges, int *order, int *active,
+		 int32_t *acc)
+{
+    twin_coord_t    top = pixmap->clip.top;
+    twin_coord_t    bottom = pixmap->clip.bottom;
+    twin_coord_t    left = pixmap->clip.left;
+    twin_coord_t    right = pixmap->clip.right;
+    int		    *bucket;
+    int		    nbucket, nactive;
+    int		    e, i, j, k;
+    twin_coord_t    y, min_c, max_c;
+    twin_fixed_t    ys, ye, yb, x;
+
+    if (!edges->n)
+	return;
+
+    /* bucket the edges by the first pixmap row they touch */
+    nbucket = bottom - top;
+    bucket = calloc (nbucket + 1, sizeof (int));
+    if (!bucket)
+	return;
+#define _twin_area_row(e)   (edges->y0[e] < twin_int_to_fixed (top) ? 0 : \
+			     twin_fixed_to_int (edges->y0[e]) - top)
+    for (e = 0; e < edges->n; e++)
+	bucket[_twin_area_row (e) + 1]++;
+    for (y = 1; y <= nbucket; y++)
+	bucket[y] += bucket[y - 1];
+    for (e = 0; e < edges->n; e++)
+	order[bucket[_twin_area_row (e)]++] = e;
+#undef _twin_area_row
+
+    e = 0;
+    nactive = 0;
+    for (y = 0; y < nbucket; y++)
+    {
+	yb = twin_int_to_fixed (y + top);
+	/* add in new edges */
+	for (; e < bucket[y]; e++)
+	{
+	    k = order[e];
+	    ys = edges->y0[k] > yb ? edges->y0[k] : yb;
+	    edges->x[k] = _twin_area_x (edges, k, ys);
+	    active[nactive++] = k;
+	}
+	if (!nactive)
+	{
+	    /* check for all done */
+	    if (e == edges->n)
+		break;
+	    continue;
+	}
+
+	min_c = right;
+	max_c = left - 1;
+	for (i = j = 0; i < nactive; i++)
+	{
+	    k = active[i];
+	    ys = edges->y0[k] > yb ? edges->y0[k] : yb;
+	    ye = edges->y1[k] < yb + TWIN_FIXED_ONE ? edges->y1[k] :
+		 yb + TWIN_FIXED_ONE;
+	    x = ye == edges->y1[k] ? edges->x1[k] : _twin_area_x (edges, k, ye);
+	    _twin_area_slice (acc, left, right, edges->x[k], x,
+			      (ye - ys) * edges->winding[k], &min_c, &max_c);
+	    edges->x[k] = x;
+	    /* keep those continuing below */
+	    if (edges->y1[k] > yb + TWIN_FIXED_ONE)
+		active[j++] = k;
+	}
+	nactive = j;
+	if (min_c <= max_c)
+	{
+	    _twin_area_resolve (pixmap, rows, y + top, acc, min_c, max_c);
+	    if (row_done)
+		(*row_done) (y + top, closure);
+	}
+    }
+    free (bucket);
+}
+
+typedef struct _twin_area_seg {
+    twin_spoint_t   a, b;
+    twin_sfixed_t   top, bot;
+    int		    n;		/* position along the contour */
+} twin_area_seg_t;
+
+static int
+_twin_area_seg_compare (const void *a, const void *b)
+{
+    const twin_area_seg_t   *sa = a, *sb = b;
+
+    return sa->top - sb->top;
+}
+
+static int
+_twin_area_orient (twin_spoint_t *a, twin_spoint_t *b, twin_spoint_t *c)
+{
+    int64_t	o = ((int64_t) (b->x - a->x) * (c->y - a->y) -
+		     (int64_t) (b->y - a->y) * (c->x - a->x));
+
+    return (o > 0) - (o < 0);
+}
+
+/*
+ * Whether two segments, already known to share some y, meet;
+ * touching counts
+ */
+static twin_bool_t
+_twin_area_meet (twin_area_seg_t *s, twin_area_seg_t *t)
+{
+    if ((s->a.x < t->a.x && s->a.x < t->b.x &&
+	 s->b.x < t->a.x && s->b.x < t->b.x) ||
+	(s->a.x > t->a.x && s->a.x > t->b.x &&
+	 s->b.x > t->a.x && s->b.x > t->b.x))
+	return TWIN_FALSE;
+    return (_twin_area_orient (&s->a, &s->b, &t->a) *
+	    _twin_area_orient (&s->a, &s->b, &t->b) <= 0 &&
+	    _twin_area_orient (&t->a, &t->b, &s->a) *
+	    _twin_area_orient (&t->a, &t->b, &s->b) <= 0);
+}
+
+/*
+ * Whether path is a single contour which never meets itself, so that
+ * its winding is only ever zero or one
+ */
+static twin_bool_t
+_twin_area_simple (twin_path_t *path)
+{
+    twin_spoint_t   *points = NULL;
+    twin_area_seg_t *segs;
+    twin_bool_t	    simple = TWIN_TRUE;
+    int		    npoints = 0;
+    int		    s, p, v, n, i, j, d;
+
+    p = 0;
+    for (s = 0; s <= path->nsublen; s++)
+    {
+	int sublen = s == path->nsublen ? path->npoints : path->sublen[s];
+
+	if (sublen - p > 1)
+	{
+	    if (points)
+		return TWIN_FALSE;
+	    points = path->points + p;
+	    npoints = sublen - p;
+	}
+	p = sublen;
+    }
+    if (npoints <= 3)
+	return TWIN_TRUE;
+    segs = malloc (npoints * sizeof (twin_area_seg_t));
+    if (!segs)
+	return TWIN_FALSE;
+    n = 0;
+    for (v = 0; v < npoints; v++)
+    {
+	twin_spoint_t	*a = &points[v];
+	twin_spoint_t	*b = &points[v + 1 == npoints ? 0 : v + 1];
+
+	if (a->x == b->x && a->y == b->y)
+	    continue;
+	segs[n].a = *a;
+	segs[n].b = *b;
+	segs[n].top = a->y < b->y ? a->y : b->y;
+	segs[n].bot = a->y < b->y ? b->y : a->y;
+	segs[n].n = n;
+	n++;
+    }
+    qsort (segs, n, sizeof (twin_area_seg_t), _twin_area_seg_compare);
+    for (i = 0; i < n && simple; i++)
+	for (j = i + 1; j < n && segs[j].top <= segs[i].bot; j++)
+	{
+	    /* neighbours always share their common point */
+	    d = segs[i].n - segs[j].n;
+	    if (d == 1 || d == -1 || d == n - 1 || d == 1 - n)
+		continue;
+	    if (_twin_area_meet (&segs[i], &segs[j]))
+	    {
+		simple = TWIN_FALSE;
+		break;
+	    }
+	}
+    free (segs);
+    return simple;
+}
+
+/*
+ * Fill path into an A8 pixmap by exact area coverage, noting the
+ * columns touched on each pixmap row in rows and calling row_done as
+ * each row is finished, when given.  Returns FALSE, with nothing
+ * drawn, for paths whose contours may overlap.
+ */
+twin_bool_t
+_twin_area_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
+		      twin_coord_t dx, twin_coord_t dy, twin_extent_t *rows,
+		      twin_row_func_t row_done, void *closure)
+{
+    twin_area_edges_t	edges;
+    twin_fixed_t	*fields;
+    int			*order;
+    int32_t		*acc;
+    int			nalloc;
+    int			s;
+    int			p;
+    twin_fixed_t	fdx = twin_int_to_fixed (dx + pixmap->origin_x);
+    twin_fixed_t	fdy = twin_int_to_fixed (dy + pixmap->origin_y);
+
+    if (pixmap->clip.left >= pixmap->clip.right ||
+	pixmap->clip.top >= pixmap->clip.bottom)
+	return TWIN_TRUE;
+    if (!_twin_area_simple (path))
+	return TWIN_FALSE;
+    nalloc = path->npoints + path->nsublen + 1;
+    /* five edge fields, the winding, the bucket order and active edges */
+    fields = malloc (nalloc * (5 * sizeof (twin_fixed_t) + 3 * sizeof (int)));
+    if (!fields)
+	return TWIN_TRUE;
+    /* one column beyond the clip on the right */
+    acc = calloc (pixmap->clip.right - pixmap->clip.left + 2, sizeof (int32_t));
+    if (!acc)
+    {
+	free (fields);
+	return TWIN_TRUE;
+    }
+    edges.n = 0;
+    edges.x0 = fields;
+    edges.y0 = fields + nalloc;
+    edges.x1 = fields + 2 * nalloc;
+    edges.y1 = fields + 3 * nalloc;
+    edges.x = fields + 4 * nalloc;
+    edges.winding = (int *) (fields + 5 * nalloc);
+    order = edges.winding + nalloc;
+    p = 0;
+    for (s = 0; s <= path->nsublen; s++)
+    {
+	int sublen;
+	int npoints;
+
+	if (s == path->nsublen)
+	    sublen = path->npoints;
+	else
+	    sublen = path->sublen[s];
+	npoints = sublen - p;
+	if (npoints > 1)
+	{
+	    _twin_area_build (path->points + p, npoints, &edges, fdx, fdy,
+			      twin_int_to_fixed (pixmap->clip.top),
+			      twin_int_to_fixed (pixmap->clip.bottom));
+	    p = sublen;
+	}
+    }
+    _twin_area_fill (pixmap, rows, row_done, closure,
+		     &edges, order, order + nalloc, acc);
+    free (acc);
+    free (fields);
+    return TWIN_TRUE;
+}
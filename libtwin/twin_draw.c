@@ -254,7 +254,179 @@ static twin_src_msk_op	comp3[2][4][4][3] = {
 };
 
     
-#define operand_index(o)    ((o)->source_kind == TWIN_SOLID ? 3 : o->u.pixmap->format)
+#define operand_solid	    3
+#define operand_index(o)    ((o)->source_kind == TWIN_SOLID ? operand_solid : o->u.pixmap->format)
+
+/*
+ * Map a coordinate outside of [min, max) back inside as extend says
+ */
+static inline twin_coord_t _twin_extend_coord (twin_coord_t v,
+					       twin_coord_t min,
+					       twin_coord_t max,
+					       twin_extend_t extend)
+{
+    twin_coord_t    n = max - min;
+
+    if (min <= v && v < max)
+	return v;
+    v -= min;
+    switch (extend) {
+    case TWIN_EXTEND_REPEAT:
+	v %= n;
+	if (v < 0)
+	    v += n;
+	break;
+    case TWIN_EXTEND_PAD:
+	v = v < 0 ? 0 : n - 1;
+	break;
+    case TWIN_EXTEND_REFLECT:
+	v %= 2 * n;
+	if (v < 0)
+	    v += 2 * n;
+	if (v >= n)
+	    v = 2 * n - 1 - v;
+	break;
+    default:
+	break;
+    }
+    return v + min;
+}
+
+static void _twin_fill_pixels (uint8_t *d, const uint8_t *p,
+			       twin_coord_t n, int bpp)
+{
+    while (n--) {
+	memcpy (d, p, bpp);
+	d += bpp;
+    }
+}
+
+/*
+ * Read width pixels of row y from x on, in the pixmap's own format,
+ * with the extend mode applied outside the clip.  Without one,
+ * those pixels are zero.
+ */
+void _twin_pixmap_read (twin_pixmap_t	*pixmap,
+			twin_coord_t	x,
+			twin_coord_t	y,
+			twin_coord_t	width,
+			twin_pointer_t	span)
+{
+    twin_extend_t   extend = pixmap->extend;
+    twin_coord_t    left = pixmap->clip.left;
+    twin_coord_t    right = pixmap->clip.right;
+    twin_coord_t    n, w = right - left, v, i;
+    int		    bpp = twin_bytes_per_pixel(pixmap->format);
+    uint8_t	    *d = span.b, *row;
+
+    if (!_twin_pixmap_extends(pixmap)) {
+	extend = TWIN_EXTEND_NONE;
+	if (y < pixmap->clip.top || y >= pixmap->clip.bottom ||
+	    left >= right) {
+	    memset (d, '\0', width * bpp);
+	    return;
+	}
+    }
+    y = _twin_extend_coord(y, pixmap->clip.top, pixmap->clip.bottom, extend);
+    row = pixmap->p.b + y * pixmap->stride;
+    while (width > 0) {
+	if (left <= x && x < right) {
+	    /* straight from the source */
+	    n = right - x;
+	    if (n > width)
+		n = width;
+	    memcpy (d, row + x * bpp, n * bpp);
+	} else if (extend == TWIN_EXTEND_NONE || extend == TWIN_EXTEND_PAD) {
+	    n = x < left ? left - x : width;
+	    if (n > width)
+		n = width;
+	    if (extend == TWIN_EXTEND_NONE)
+		memset (d, '\0', n * bpp);
+	    else
+		_twin_fill_pixels (d, row + (x < left ? left : right - 1) * bpp,
+				   n, bpp);
+	} else if (extend == TWIN_EXTEND_REPEAT) {
+	    v = _twin_extend_coord(x, left, right, extend);
+	    n = right - v;
+	    if (n > width)
+		n = width;
+	    memcpy (d, row + v * bpp, n * bpp);
+	} else {
+	    v = (x - left) % (2 * w);
+	    if (v < 0)
+		v += 2 * w;
+	    if (v < w) {
+		n = w - v;
+		if (n > width)
+		    n = width;
+		memcpy (d, row + (left + v) * bpp, n * bpp);
+	    } else {
+		/* a mirrored tile, walking back towards left */
+		v = left + 2 * w - 1 - v;
+		n = v - left + 1;
+		if (n > width)
+		    n = width;
+		for (i = 0; i < n; i++)
+		    memcpy (d + i * bpp, row + (v - i) * bpp, bpp);
+	    }
+	}
+	d += n * bpp;
+	x += n;
+	width -= n;
+    }
+}
+
+/*
+ * A row of pixmap to read width pixels from: the pixels themselves
+ * when they are all inside the clip, else a copy made by
+ * _twin_pixmap_read in the scratch buffer for slot
+ */
+twin_pointer_t _twin_pixmap_span (twin_pixmap_t	*pixmap,
+				  twin_coord_t	x,
+				  twin_coord_t	y,
+				  twin_coord_t	width,
+				  int		slot)
+{
+    twin_pointer_t  span;
+
+    if (pixmap->clip.left <= x && x + width <= pixmap->clip.right &&
+	pixmap->clip.top <= y && y < pixmap->clip.bottom)
+	return twin_pixmap_pointer (pixmap, x, y);
+    span.v = _twin_scratch_alloc(slot, width *
+				 twin_bytes_per_pixel(pixmap->format));
+    if (span.v)
+	_twin_pixmap_read (pixmap, x, y, width, span);
+    return span;
+}
+
+/*
+ * A row of an operand pixmap; those without an extend mode are read
+ * directly
+ */
+static inline twin_pointer_t _twin_operand_span (twin_operand_t *o,
+						 twin_coord_t x,
+						 twin_coord_t y,
+						 twin_coord_t width,
+						 int slot)
+{
+    if (!_twin_pixmap_extends(o->u.pixmap))
+	return twin_pixmap_pointer (o->u.pixmap, x, y);
+    return _twin_pixmap_span (o->u.pixmap, x, y, width, slot);
+}
+
+/*
+ * Make sure the scratch span for an extended operand can be had,
+ * so that _twin_operand_span need not fail later
+ */
+static twin_bool_t _twin_operand_reserve (twin_operand_t *o,
+					  twin_coord_t width, int slot)
+{
+    if (!o || o->source_kind != TWIN_PIXMAP ||
+	!_twin_pixmap_extends(o->u.pixmap))
+	return TWIN_TRUE;
+    return _twin_scratch_alloc(slot, width *
+			       twin_bytes_per_pixel(o->u.pixmap->format)) != NULL;
+}
 
 /* XXX Fixme: source clipping is busted
  */
@@ -296,6 +468,10 @@ static void _twin_composite_simple (twin_pixmap_t	*dst,
     if (left >= right || top >= bottom)
 	return;
 
+    if (!_twin_operand_reserve (src, right - left, TWIN_SCRATCH_SRC) ||
+	!_twin_operand_reserve (msk, right - left, TWIN_SCRATCH_MSK))
+	return;
+
     if (src->source_kind == TWIN_PIXMAP) {
 	src_x += src->u.pixmap->origin_x;
 	src_y += src->u.pixmap->origin_y;
@@ -323,9 +499,11 @@ static void _twin_composite_simple (twin_pixmap_t	*dst,
 	for (iy = top; iy < bottom; iy++)
 	{
 	    if (src->source_kind == TWIN_PIXMAP)
-		s.p = twin_pixmap_pointer (src->u.pixmap, left+sdx, iy+sdy);
+		s.p = _twin_operand_span (src, left+sdx, iy+sdy,
+					  right - left, TWIN_SCRATCH_SRC);
 	    if (msk->source_kind == TWIN_PIXMAP)
-		m.p = twin_pixmap_pointer (msk->u.pixmap, left+mdx, iy+mdy);
+		m.p = _twin_operand_span (msk, left+mdx, iy+mdy,
+					  right - left, TWIN_SCRATCH_MSK);
 	    (*op) (twin_pixmap_pointer (dst, left, iy), s, m, right - left);
 	}
     }
@@ -338,7 +516,8 @@ static void _twin_composite_simple (twin_pixmap_t	*dst,
 	for (iy = top; iy < bottom; iy++)
 	{
 	    if (src->source_kind == TWIN_PIXMAP)
-		s.p = twin_pixmap_pointer (src->u.pixmap, left+sdx, iy+sdy);
+		s.p = _twin_operand_span (src, left+sdx, iy+sdy,
+					  right - left, TWIN_SCRATCH_SRC);
 	    (*op) (twin_pixmap_pointer (dst, left, iy), s, right - left);
 	}
     }
@@ -352,173 +531,304 @@ static inline int operand_xindex(twin_operand_t	*o)
     return ind != TWIN_RGB16 ? ind : TWIN_ARGB32;
 }
 
-static twin_xform_t *twin_pixmap_init_xform (twin_pixmap_t *pixmap,
-					     twin_coord_t left, twin_coord_t width,
-					     twin_coord_t src_x, twin_coord_t src_y)
+#define _twin_fixed_whole(f)	(((f) & 0xffff) == 0)
+
+static twin_xform_kind_t _twin_xform_kind (twin_matrix_t *m)
+{
+    if (m->m[0][1] != 0 || m->m[1][0] != 0)
+	return TWIN_XFORM_AFFINE;
+    if (!_twin_fixed_whole(m->m[0][0]) || !_twin_fixed_whole(m->m[1][1]) ||
+	!_twin_fixed_whole(m->m[2][0]) || !_twin_fixed_whole(m->m[2][1]))
+	return TWIN_XFORM_AXIS;
+    if (m->m[0][0] != TWIN_FIXED_ONE || m->m[1][1] != TWIN_FIXED_ONE)
+	return TWIN_XFORM_SCALE;
+    return TWIN_XFORM_TRANSLATE;
+}
+
+/*
+ * The span comes from the thread's scratch buffer for slot, so
+ * there is nothing to free afterwards
+ */
+static twin_bool_t twin_pixmap_init_xform (twin_xform_t *xform, int slot,
+					   twin_pixmap_t *pixmap,
+					   twin_coord_t left, twin_coord_t width,
+					   twin_coord_t src_x, twin_coord_t src_y)
 {
-    twin_xform_t	*xform;
     twin_format_t	fmt = pixmap->format;
 
     if (fmt == TWIN_RGB16)
 	fmt = TWIN_ARGB32;
 
-    xform = calloc(1, sizeof (twin_xform_t) +
-		   width * twin_bytes_per_pixel(fmt));
-    if (xform == NULL)
-	return NULL;
+    xform->span.v = _twin_scratch_alloc(slot,
+					width * twin_bytes_per_pixel(fmt));
+    if (xform->span.v == NULL)
+	return TWIN_FALSE;
 
-    xform->span.v = (twin_argb32_t *)(char *)(xform + 1);
     xform->pixmap = pixmap;
     xform->left = left;
     xform->width = width;
     xform->src_x = src_x;
     xform->src_y = src_y;
+    xform->kind = _twin_xform_kind(&pixmap->transform);
 
-    return xform;
+    return TWIN_TRUE;
 }
 
-static void twin_pixmap_free_xform (twin_xform_t *xform)
+#define FX(x)	twin_int_to_fixed(x)
+#define XF(x)	twin_fixed_to_int(x)
+
+#define _pix_lerp(a, b, w) \
+	((((b) * (w)) + ((a) * (TWIN_FIXED_ONE - (w)))) >> 16)
+
+/*
+ * Lerp two channels at a time, one in each half of a 64 bit value
+ * so there is room for the 16 bit weight
+ */
+#define _pix_spread(c)	(((uint64_t) (c) & 0xff) | \
+			 (((uint64_t) (c) & 0xff0000) << 16))
+
+#define _pix_lerp2(a, b, w) \
+	((((b) * (w) + (a) * (TWIN_FIXED_ONE - (w))) >> 16) & \
+	 0x000000ff000000ffULL)
+
+static inline twin_argb32_t _twin_argb32_lerp (twin_argb32_t a,
+					       twin_argb32_t b,
+					       unsigned int w)
 {
-    if (xform)
-	free (xform);
+    uint64_t	l = _pix_lerp2(_pix_spread(a), _pix_spread(b), w);
+    uint64_t	h = _pix_lerp2(_pix_spread(a >> 8), _pix_spread(b >> 8), w);
+
+    return (twin_argb32_t) (l | (l >> 16) | ((h | (h >> 16)) << 8));
 }
 
-#define FX(x)	twin_int_to_fixed(x)
-#define XF(x)	twin_fixed_to_int(x)
+/*
+ * Transformed sources are read a span at a time into xform->span,
+ * converting rgb16 to argb32 on the way.  The source position is
+ * stepped along the span instead of being recomputed per pixel.
+ */
+#define xform_type_a8		twin_a8_t
+#define xform_type_rgb16	twin_argb32_t
+#define xform_type_argb32	twin_argb32_t
+
+#define xform_get_a8(r, x)	((r).a8[x])
+#define xform_get_rgb16(r, x)	twin_rgb16_to_argb32((r).rgb16[x])
+#define xform_get_argb32(r, x)	((r).argb32[x])
+
+#define xform_lerp_a8(a, b, w)	    _pix_lerp(a, b, w)
+#define xform_lerp_rgb16(a, b, w)   _twin_argb32_lerp(a, b, w)
+#define xform_lerp_argb32(a, b, w)  _twin_argb32_lerp(a, b, w)
 
 /* we are doing clipping on source... dunno if that makes much sense
  * but here we go ... if we decide that source clipping makes no sense
  * then we need to still test wether we fit in the pixmap boundaries
  * here. source clipping is useful if you try to extract one image
  * out of a big picture though.
+ * Pixels outside the clip read as zero.
  */
-#define _pix_clipped(pix, x, y) \
-	((x) < FX((pix)->clip.left) || (x) >= FX((pix)->clip.right) || \
-	 (y) < FX((pix)->clip.top)  || (y) >= FX((pix)->clip.bottom))
-
-#define _get_pix_8(d, pix, x, y) \
-    do { \
-	(d) = _pix_clipped(pix, x, y) ? 0 : \
-	          *((pix)->p.a8 + XF(y) * (pix)->stride + XF(x)); \
-    } while(0)
-
-#define _get_pix_16(d, pix, x, y) \
-    do { \
-	twin_rgb16_t p = _pix_clipped(pix, x, y) ? 0 : \
-	    *((pix)->p.argb32 + XF(y) * ((pix)->stride >> 1) + XF(x)); \
-	*((twin_argb32_t *)(char *)(d)) = twin_rgb16_to_argb32(p); \
-    } while(0)
-
-#define _get_pix_32(d, pix, x, y) \
-    do { \
-	twin_argb32_t p = _pix_clipped(pix, x, y) ? 0 : \
-	    *((pix)->p.argb32 + XF(y) * ((pix)->stride >> 2) + XF(x)); \
-	*((twin_argb32_t *)(char *)(d)) = p; \
-    } while(0)
-
-
-#define _pix_saucemix(tl, tr, bl, br, wx, wy) \
-	(( ((((br * wx) + (bl * (TWIN_FIXED_ONE - wx))) >> 16) \
-		* wy) + \
-	   ((((tr * wx) + (tl * (TWIN_FIXED_ONE - wx))) >> 16) \
-		* (TWIN_FIXED_ONE - wy)) \
-	 ) >> 16)
-
-
-static void twin_pixmap_read_xform_8 (twin_xform_t *xform, twin_coord_t line)
+#define xform_fetch(fmt, pix, r, x) \
+	((r).v && (x) >= (pix)->clip.left && (x) < (pix)->clip.right ? \
+	 xform_get_##fmt(r, x) : 0)
+
+#define xform_blend(fmt, tl, tr, bl, br, wx, wy) \
+	xform_lerp_##fmt(xform_lerp_##fmt(tl, tr, wx), \
+			 xform_lerp_##fmt(bl, br, wx), wy)
+
+/* both columns inside the clip */
+#define xform_inside(pix, x) \
+	((x) >= (pix)->clip.left && (x) + 1 < (pix)->clip.right)
+
+#define xform_lerp_row(fmt, pix, t, x, wx) \
+	(xform_inside(pix, x) ? \
+	 xform_lerp_##fmt(xform_get_##fmt(t, x), \
+			  xform_get_##fmt(t, (x) + 1), wx) : \
+	 xform_lerp_##fmt(xform_fetch(fmt, pix, t, x), \
+			  xform_fetch(fmt, pix, t, (x) + 1), wx))
+
+#define xform_mix(fmt, pix, t, b, x, wx, wy) \
+	((t).v && (b).v && xform_inside(pix, x) ? \
+	 xform_blend(fmt, xform_get_##fmt(t, x), \
+		     xform_get_##fmt(t, (x) + 1), \
+		     xform_get_##fmt(b, x), \
+		     xform_get_##fmt(b, (x) + 1), wx, wy) : \
+	 xform_blend(fmt, xform_fetch(fmt, pix, t, x), \
+		     xform_fetch(fmt, pix, t, (x) + 1), \
+		     xform_fetch(fmt, pix, b, x), \
+		     xform_fetch(fmt, pix, b, (x) + 1), wx, wy))
+
+static inline twin_pointer_t _twin_xform_row (twin_pixmap_t *pix,
+					      twin_coord_t y)
 {
-    twin_fixed_t dx, dy, sx, sy;
-    unsigned int wx, wy;
-    twin_a8_t pts[4];
-    twin_a8_t *dst = xform->span.a8;
-    twin_pixmap_t *pix = xform->pixmap;
-    twin_matrix_t *tfm = &xform->pixmap->transform;
-
-    /* for each row in the dest line */
-    dy = twin_int_to_fixed(line);
-    for (dx = 0; dx < twin_int_to_fixed(xform->width); dx += TWIN_FIXED_ONE) {
-	sx = _twin_matrix_fx(tfm, dx, dy) + FX(xform->src_x);
-	sy = _twin_matrix_fy(tfm, dx, dy) + FX(xform->src_y);
-	_get_pix_8(pts[0], pix, sx, sy);
-	_get_pix_8(pts[1], pix, sx + TWIN_FIXED_ONE, sy);
-	_get_pix_8(pts[2], pix, sx, sy + TWIN_FIXED_ONE);
-	_get_pix_8(pts[3], pix, sx, sy + TWIN_FIXED_ONE);
-	wx = sx & 0xffff;
-	wy = sy & 0xffff;
-	*(dst++) = _pix_saucemix(pts[0], pts[1], pts[2], pts[4], wx, wy);
-    }
+    twin_pointer_t  r;
+
+    if (y < pix->clip.top || y >= pix->clip.bottom)
+	r.v = NULL;
+    else
+	r.b = pix->p.b + y * pix->stride;
+    return r;
 }
 
-static void twin_pixmap_read_xform_16 (twin_xform_t *xform, twin_coord_t line)
+/* a pixel of an extended source, its position mapped into the clip */
+#define xform_extend(fmt, pix, x, y) \
+	xform_get_##fmt(_twin_xform_row(pix, \
+			_twin_extend_coord(y, (pix)->clip.top, \
+					   (pix)->clip.bottom, \
+					   (pix)->extend)), \
+			_twin_extend_coord(x, (pix)->clip.left, \
+					   (pix)->clip.right, \
+					   (pix)->extend))
+
+static inline twin_coord_t _twin_xform_clamp (twin_coord_t v,
+					      twin_coord_t min,
+					      twin_coord_t max)
 {
-    twin_fixed_t dx, dy, sx, sy;
-    unsigned int wx, wy;
-    twin_a8_t pts[4][4];
-    twin_a8_t *dst = xform->span.a8;
-    twin_pixmap_t *pix = xform->pixmap;
-    twin_matrix_t *tfm = &xform->pixmap->transform;
-
-    /* for each row in the dest line */
-    dy = twin_int_to_fixed(line);
-    for (dx = 0; dx < twin_int_to_fixed(xform->width); dx += TWIN_FIXED_ONE) {
-	sx = _twin_matrix_fx(tfm, dx, dy) + FX(xform->src_x);
-	sy = _twin_matrix_fy(tfm, dx, dy) + FX(xform->src_y);
-	_get_pix_16(pts[0], pix, sx, sy);
-	_get_pix_16(pts[1], pix, sx + TWIN_FIXED_ONE, sy);
-	_get_pix_16(pts[2], pix, sx, sy + TWIN_FIXED_ONE);
-	_get_pix_16(pts[3], pix, sx + TWIN_FIXED_ONE, sy + TWIN_FIXED_ONE);
-	wx = sx & 0xffff;
-	wy = sy & 0xffff;
-	*(dst++) = _pix_saucemix(pts[0][0], pts[1][0],
-				 pts[2][0], pts[3][0], wx, wy);
-	*(dst++) = _pix_saucemix(pts[0][1], pts[1][1],
-				 pts[2][1], pts[3][1], wx, wy);
-	*(dst++) = _pix_saucemix(pts[0][2], pts[1][2],
-				 pts[2][2], pts[3][2], wx, wy);
-	*(dst++) = _pix_saucemix(pts[0][3], pts[1][3],
-				 pts[2][3], pts[3][3], wx, wy);
-    }
+    return v < min ? min : v > max ? max : v;
 }
 
-static void twin_pixmap_read_xform_32 (twin_xform_t *xform, twin_coord_t line)
-{
-    twin_fixed_t dx, dy, sx, sy;
-    unsigned int wx, wy;
-    twin_a8_t pts[4][4];
-    twin_a8_t *dst = xform->span.a8;
-    twin_pixmap_t *pix = xform->pixmap;
-    twin_matrix_t *tfm = &xform->pixmap->transform;
-
-    /* for each row in the dest line */
-    dy = twin_int_to_fixed(line);
-    for (dx = 0; dx < twin_int_to_fixed(xform->width); dx += TWIN_FIXED_ONE) {
-	sx = _twin_matrix_fx(tfm, dx, dy) + FX(xform->src_x);
-	sy = _twin_matrix_fy(tfm, dx, dy) + FX(xform->src_y);
-	_get_pix_32(pts[0], pix, sx, sy);
-	_get_pix_32(pts[1], pix, sx + TWIN_FIXED_ONE, sy);
-	_get_pix_32(pts[2], pix, sx, sy + TWIN_FIXED_ONE);
-	_get_pix_32(pts[3], pix, sx + TWIN_FIXED_ONE, sy + TWIN_FIXED_ONE);
-	wx = sx & 0xffff;
-	wy = sy & 0xffff;
-	*(dst++) = _pix_saucemix(pts[0][0], pts[1][0],
-				 pts[2][0], pts[3][0], wx, wy);
-	*(dst++) = _pix_saucemix(pts[0][1], pts[1][1],
-				 pts[2][1], pts[3][1], wx, wy);
-	*(dst++) = _pix_saucemix(pts[0][2], pts[1][2],
-				 pts[2][2], pts[3][2], wx, wy);
-	*(dst++) = _pix_saucemix(pts[0][3], pts[1][3],
-				 pts[2][3], pts[3][3], wx, wy);
-    }
+/*
+ * Bilinear samples along a line of the source, stepping (ux, uy)
+ * from (sx, sy); the SIMD versions must give identical results
+ */
+#define make_twin_bilinear(fmt) \
+void _twin_##fmt##_bilinear (twin_pointer_t dst_p, twin_pixmap_t *pix, \
+			     twin_fixed_t sx, twin_fixed_t sy, \
+			     twin_fixed_t ux, twin_fixed_t uy, \
+			     twin_coord_t width) \
+{ \
+    xform_type_##fmt	*dst = dst_p.v; \
+    twin_coord_t	x, y, i; \
+    twin_pointer_t	t, b; \
+    unsigned int	wx, wy; \
+ \
+    if (_twin_pixmap_extends(pix)) { \
+	/* taps outside the clip come from the extend mode */ \
+	for (i = 0; i < width; i++, sx += ux, sy += uy) { \
+	    x = XF(sx); \
+	    y = XF(sy); \
+	    dst[i] = xform_blend(fmt, xform_extend(fmt, pix, x, y), \
+				 xform_extend(fmt, pix, x + 1, y), \
+				 xform_extend(fmt, pix, x, y + 1), \
+				 xform_extend(fmt, pix, x + 1, y + 1), \
+				 sx & 0xffff, sy & 0xffff); \
+	} \
+	return; \
+    } \
+    if (uy == 0) { \
+	/* one pair of rows for the whole line */ \
+	t = _twin_xform_row(pix, XF(sy)); \
+	b = _twin_xform_row(pix, XF(sy) + 1); \
+	wy = sy & 0xffff; \
+	for (i = 0; i < width; i++, sx += ux) { \
+	    x = XF(sx); \
+	    wx = sx & 0xffff; \
+	    if (wy == 0) \
+		/* the row below has no weight */ \
+		dst[i] = t.v ? xform_lerp_row(fmt, pix, t, x, wx) : 0; \
+	    else \
+		dst[i] = xform_mix(fmt, pix, t, b, x, wx, wy); \
+	} \
+	return; \
+    } \
+    for (i = 0; i < width; i++, sx += ux, sy += uy) { \
+	x = XF(sx); \
+	t = _twin_xform_row(pix, XF(sy)); \
+	b = _twin_xform_row(pix, XF(sy) + 1); \
+	wx = sx & 0xffff; \
+	wy = sy & 0xffff; \
+	dst[i] = xform_mix(fmt, pix, t, b, x, wx, wy); \
+    } \
 }
 
+make_twin_bilinear(a8)
+make_twin_bilinear(rgb16)
+make_twin_bilinear(argb32)
+
+/* bilinear fetchers by source format, see _twin_draw_set_features */
+static twin_bilinear_func   *bilinear[3] = {
+    _twin_a8_bilinear,
+    _twin_rgb16_bilinear,
+    _twin_argb32_bilinear,
+};
+
+#define make_twin_read_xform(fmt) \
+static void twin_pixmap_read_xform_##fmt (twin_xform_t *xform, \
+					  twin_coord_t line) \
+{ \
+    twin_pixmap_t	*pix = xform->pixmap; \
+    twin_matrix_t	*tfm = &pix->transform; \
+    xform_type_##fmt	*dst = xform->span.v; \
+    twin_coord_t	width = xform->width; \
+    twin_fixed_t	ux = tfm->m[0][0], uy = tfm->m[0][1]; \
+    twin_fixed_t	sx, sy; \
+    twin_coord_t	x, dx, i, l, r; \
+    twin_pointer_t	t; \
+ \
+    /* source position of the first pixel in the line */ \
+    sx = twin_fixed_mul(tfm->m[1][0], twin_int_to_fixed(line)) + \
+	tfm->m[2][0] + FX(xform->src_x); \
+    sy = twin_fixed_mul(tfm->m[1][1], twin_int_to_fixed(line)) + \
+	tfm->m[2][1] + FX(xform->src_y); \
+ \
+    if (_twin_pixmap_extends(pix) && \
+	(xform->kind < TWIN_XFORM_AXIS || \
+	 pix->filter == TWIN_FILTER_NEAREST)) { \
+	for (i = 0; i < width; i++, sx += ux, sy += uy) \
+	    dst[i] = xform_extend(fmt, pix, XF(sx), XF(sy)); \
+	return; \
+    } \
+    switch (xform->kind) { \
+    case TWIN_XFORM_TRANSLATE: \
+	x = XF(sx); \
+	t = _twin_xform_row(pix, XF(sy)); \
+	l = _twin_xform_clamp(pix->clip.left - x, 0, width); \
+	r = _twin_xform_clamp(pix->clip.right - x, l, width); \
+	if (!t.v) \
+	    l = r = 0; \
+	for (i = 0; i < l; i++) \
+	    dst[i] = 0; \
+	for (; i < r; i++) \
+	    dst[i] = xform_get_##fmt(t, x + i); \
+	for (; i < width; i++) \
+	    dst[i] = 0; \
+	break; \
+    case TWIN_XFORM_SCALE: \
+	x = XF(sx); \
+	dx = XF(ux); \
+	t = _twin_xform_row(pix, XF(sy)); \
+	for (i = 0; i < width; i++, x += dx) \
+	    dst[i] = xform_fetch(fmt, pix, t, x); \
+	break; \
+    default: \
+	if (pix->filter == TWIN_FILTER_BILINEAR) { \
+	    (*bilinear[pix->format]) (xform->span, pix, sx, sy, ux, uy, \
+				      width); \
+	    break; \
+	} \
+	if (uy == 0) { \
+	    t = _twin_xform_row(pix, XF(sy)); \
+	    for (i = 0; i < width; i++, sx += ux) \
+		dst[i] = xform_fetch(fmt, pix, t, XF(sx)); \
+	    break; \
+	} \
+	for (i = 0; i < width; i++, sx += ux, sy += uy) { \
+	    t = _twin_xform_row(pix, XF(sy)); \
+	    dst[i] = xform_fetch(fmt, pix, t, XF(sx)); \
+	} \
+	break; \
+    } \
+}
+
+make_twin_read_xform(a8)
+make_twin_read_xform(rgb16)
+make_twin_read_xform(argb32)
+
 static void twin_pixmap_read_xform (twin_xform_t *xform, twin_coord_t line)
 {
     if (xform->pixmap->format == TWIN_A8)
-	twin_pixmap_read_xform_8(xform, line);
+	twin_pixmap_read_xform_a8(xform, line);
     else if (xform->pixmap->format == TWIN_RGB16)
-	twin_pixmap_read_xform_16(xform, line);
+	twin_pixmap_read_xform_rgb16(xform, line);
     else if (xform->pixmap->format == TWIN_ARGB32)
-	twin_pixmap_read_xform_32(xform, line);
+	twin_pixmap_read_xform_argb32(xform, line);
 }
 
 static void _twin_composite_xform (twin_pixmap_t	*dst,
@@ -536,7 +846,7 @@ static void _twin_composite_xform (twin_pixmap_t	*dst,
 {
     twin_coord_t    iy;
     twin_coord_t    left, top, right, bottom;
-    twin_xform_t    *sxform = NULL, *mxform = NULL;
+    twin_xform_t    sxform, mxform;
     twin_source_u   s;
 
     dst_x += dst->origin_x;
@@ -565,11 +875,11 @@ static void _twin_composite_xform (twin_pixmap_t	*dst,
     if (src->source_kind == TWIN_PIXMAP) {	
 	src_x += src->u.pixmap->origin_x;
 	src_y += src->u.pixmap->origin_y;
-	sxform = twin_pixmap_init_xform(src->u.pixmap, left, width,
-					src_x, src_y);
-	if (sxform == NULL)
+	if (!twin_pixmap_init_xform(&sxform, TWIN_SCRATCH_SRC,
+				    src->u.pixmap, left, width,
+				    src_x, src_y))
 	    return;
-	s.p = sxform->span;
+	s.p = sxform.span;
     } else
         s.c = src->u.argb;
 
@@ -580,11 +890,11 @@ static void _twin_composite_xform (twin_pixmap_t	*dst,
 	if (msk->source_kind == TWIN_PIXMAP) {
 	    msk_x += msk->u.pixmap->origin_x;
 	    msk_y += msk->u.pixmap->origin_y;
-	    mxform = twin_pixmap_init_xform(msk->u.pixmap, left, width,
-					    msk_x, msk_y);
-	    if (mxform == NULL)
+	    if (!twin_pixmap_init_xform(&mxform, TWIN_SCRATCH_MSK,
+					msk->u.pixmap, left, width,
+					msk_x, msk_y))
 		return;
-	    m.p = mxform->span;
+	    m.p = mxform.span;
 	} else
 	    m.c = msk->u.argb;
 	
@@ -592,9 +902,9 @@ static void _twin_composite_xform (twin_pixmap_t	*dst,
 		[dst->format];
 	for (iy = top; iy < bottom; iy++) {
 	    if (src->source_kind == TWIN_PIXMAP)
-		twin_pixmap_read_xform (sxform, iy - top);
+		twin_pixmap_read_xform (&sxform, iy - top);
 	    if (msk->source_kind == TWIN_PIXMAP)
-		twin_pixmap_read_xform (mxform, iy - top);
+		twin_pixmap_read_xform (&mxform, iy - top);
 	    (*op) (twin_pixmap_pointer (dst, left, iy), s, m, right - left);
 	}
     } else {
@@ -604,13 +914,11 @@ static void _twin_composite_xform (twin_pixmap_t	*dst,
 
 	for (iy = top; iy < bottom; iy++) {
 	     if (src->source_kind == TWIN_PIXMAP)
-		twin_pixmap_read_xform (sxform, iy - top);
+		twin_pixmap_read_xform (&sxform, iy - top);
 	    (*op) (twin_pixmap_pointer (dst, left, iy), s, right - left);
 	}
     }
     twin_pixmap_damage (dst, left, top, right, bottom);
-    twin_pixmap_free_xform(sxform);
-    twin_pixmap_free_xform(mxform);
 }
 
 void twin_composite (twin_pixmap_t	*dst,
@@ -641,6 +949,54 @@ void twin_composite (twin_pixmap_t	*dst,
 			       operator, width, height);
 }
 
+/*
+ * Composite one row through a span of A8 coverage, width pixels
+ * long.  The caller marks the damage.
+ */
+void _twin_composite_span (twin_pixmap_t	    *dst,
+			   twin_coord_t		    dst_x,
+			   twin_coord_t		    dst_y,
+			   twin_operand_t	    *src,
+			   twin_coord_t		    src_x,
+			   twin_coord_t		    src_y,
+			   const twin_a8_t	    *cover,
+			   twin_operator_t	    operator,
+			   twin_coord_t		    width)
+{
+    twin_coord_t    left, right;
+    twin_source_u   s, m;
+    twin_src_msk_op op;
+
+    dst_x += dst->origin_x;
+    dst_y += dst->origin_y;
+    if (dst_y < dst->clip.top || dst_y >= dst->clip.bottom)
+	return;
+    left = dst_x;
+    right = dst_x + width;
+
+    /* clip */
+    if (left < dst->clip.left)
+	left = dst->clip.left;
+    if (right > dst->clip.right)
+	right = dst->clip.right;
+    if (left >= right)
+	return;
+
+    if (src->source_kind == TWIN_PIXMAP) {
+	src_x += src->u.pixmap->origin_x + left - dst_x;
+	src_y += src->u.pixmap->origin_y;
+	s.p = _twin_operand_span (src, src_x, src_y, right - left,
+				  TWIN_SCRATCH_SRC);
+	if (!s.p.v)
+	    return;
+    } else
+        s.c = src->u.argb;
+    m.p.a8 = (twin_a8_t *) cover + (left - dst_x);
+
+    op = comp3[operator][operand_index(src)][TWIN_A8][dst->format];
+    (*op) (twin_pixmap_pointer (dst, left, dst_y), s, m, right - left);
+}
+
 void twin_premultiply_alpha(twin_pixmap_t *px)
 {
     int x, y;
@@ -719,16 +1075,186 @@ twin_fill (twin_pixmap_t    *dst,
     twin_pixmap_damage (dst, left, top, right, bottom);
 }
 
+/*
+ * Replacements for the C operators, used when the CPU has the
+ * feature.  Entries are applied in order, so later ones (built on
+ * more capable features) win; solid sources update fill as well
+ */
+#define IMPL(f,o,s,d,fn)	{ f, o, s, -1, d, fn, NULL }
+#define IMPL_MSK(f,o,s,m,d,fn)	{ f, o, s, m, d, NULL, fn }
+
+/* the generic vector operators cover the whole over matrix */
+#define VEXT_OVER_DST(s,S,d,D) \
+    IMPL (TWIN_FEATURE_VECTOR, TWIN_OVER, S, D, _twin_vext_##s##_over_##d)
+#define VEXT_OVER(s,S) \
+    VEXT_OVER_DST (s, S, a8, TWIN_A8), \
+    VEXT_OVER_DST (s, S, rgb16, TWIN_RGB16), \
+    VEXT_OVER_DST (s, S, argb32, TWIN_ARGB32)
+#define VEXT_IN_OVER_DST(s,S,m,M,d,D) \
+    IMPL_MSK (TWIN_FEATURE_VECTOR, TWIN_OVER, S, M, D, \
+	      _twin_vext_##s##_in_##m##_over_##d)
+#define VEXT_IN_OVER_MSK(s,S,m,M) \
+    VEXT_IN_OVER_DST (s, S, m, M, a8, TWIN_A8), \
+    VEXT_IN_OVER_DST (s, S, m, M, rgb16, TWIN_RGB16), \
+    VEXT_IN_OVER_DST (s, S, m, M, argb32, TWIN_ARGB32)
+#define VEXT_IN_OVER(s,S) \
+    VEXT_IN_OVER_MSK (s, S, a8, TWIN_A8), \
+    VEXT_IN_OVER_MSK (s, S, rgb16, TWIN_RGB16), \
+    VEXT_IN_OVER_MSK (s, S, argb32, TWIN_ARGB32), \
+    VEXT_IN_OVER_MSK (s, S, c, operand_solid)
+
+typedef struct _twin_draw_impl {
+    unsigned int	feature;
+    twin_operator_t	operator;
+    int			src;	/* format, or operand_solid */
+    int			msk;	/* format, or -1 for none */
+    twin_format_t	dst;
+    twin_src_op		op;
+    twin_src_msk_op	msk_op;
+} twin_draw_impl_t;
+
+static const twin_draw_impl_t	impls[] = {
+#ifdef HAVE_VECTOR
+    VEXT_OVER (argb32, TWIN_ARGB32),
+    VEXT_OVER (rgb16, TWIN_RGB16),
+    VEXT_OVER (a8, TWIN_A8),
+    VEXT_OVER (c, operand_solid),
+    VEXT_IN_OVER (argb32, TWIN_ARGB32),
+    VEXT_IN_OVER (rgb16, TWIN_RGB16),
+    VEXT_IN_OVER (a8, TWIN_A8),
+    VEXT_IN_OVER (c, operand_solid),
+#endif /* HAVE_VECTOR */
+#ifdef HAVE_ALTIVEC
+    IMPL (TWIN_FEATURE_ALTIVEC, TWIN_OVER, TWIN_ARGB32, TWIN_ARGB32,
+	  _twin_vec_argb32_over_argb32),
+    IMPL (TWIN_FEATURE_ALTIVEC, TWIN_SOURCE, TWIN_ARGB32, TWIN_ARGB32,
+	  _twin_vec_argb32_source_argb32),
+#endif /* HAVE_ALTIVEC */
+#ifdef HAVE_SSE2
+    IMPL (TWIN_FEATURE_SSE2, TWIN_OVER, TWIN_ARGB32, TWIN_ARGB32,
+	  _twin_sse2_argb32_over_argb32),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_SOURCE, TWIN_ARGB32, TWIN_ARGB32,
+	  _twin_sse2_argb32_source_argb32),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_OVER, TWIN_RGB16, TWIN_ARGB32,
+	  _twin_sse2_rgb16_source_argb32),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_SOURCE, TWIN_RGB16, TWIN_ARGB32,
+	  _twin_sse2_rgb16_source_argb32),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_OVER, TWIN_ARGB32, TWIN_RGB16,
+	  _twin_sse2_argb32_over_rgb16),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_SOURCE, TWIN_ARGB32, TWIN_RGB16,
+	  _twin_sse2_argb32_source_rgb16),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_OVER, TWIN_RGB16, TWIN_RGB16,
+	  _twin_sse2_rgb16_source_rgb16),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_SOURCE, TWIN_RGB16, TWIN_RGB16,
+	  _twin_sse2_rgb16_source_rgb16),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_OVER, operand_solid, TWIN_ARGB32,
+	  _twin_sse2_c_over_argb32),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_SOURCE, operand_solid, TWIN_ARGB32,
+	  _twin_sse2_c_source_argb32),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_OVER, operand_solid, TWIN_RGB16,
+	  _twin_sse2_c_over_rgb16),
+    IMPL (TWIN_FEATURE_SSE2, TWIN_SOURCE, operand_solid, TWIN_RGB16,
+	  _twin_sse2_c_source_rgb16),
+    IMPL_MSK (TWIN_FEATURE_SSE2, TWIN_OVER, operand_solid, TWIN_A8,
+	      TWIN_ARGB32, _twin_sse2_c_in_a8_over_argb32),
+    IMPL_MSK (TWIN_FEATURE_SSE2, TWIN_OVER, operand_solid, TWIN_A8,
+	      TWIN_RGB16, _twin_sse2_c_in_a8_over_rgb16),
+    IMPL_MSK (TWIN_FEATURE_SSE2, TWIN_OVER, operand_solid, TWIN_A8,
+	      TWIN_A8, _twin_sse2_c_in_a8_over_a8),
+#endif /* HAVE_SSE2 */
+#ifdef HAVE_AVX2
+    IMPL (TWIN_FEATURE_AVX2, TWIN_OVER, TWIN_ARGB32, TWIN_ARGB32,
+	  _twin_avx2_argb32_over_argb32),
+    IMPL (TWIN_FEATURE_AVX2, TWIN_OVER, TWIN_RGB16, TWIN_ARGB32,
+	  _twin_avx2_rgb16_source_argb32),
+    IMPL (TWIN_FEATURE_AVX2, TWIN_SOURCE, TWIN_RGB16, TWIN_ARGB32,
+	  _twin_avx2_rgb16_source_argb32),
+    IMPL (TWIN_FEATURE_AVX2, TWIN_OVER, TWIN_ARGB32, TWIN_RGB16,
+	  _twin_avx2_argb32_over_rgb16),
+    IMPL_MSK (TWIN_FEATURE_AVX2, TWIN_OVER, operand_solid, TWIN_A8,
+	      TWIN_ARGB32, _twin_avx2_c_in_a8_over_argb32),
+    IMPL_MSK (TWIN_FEATURE_AVX2, TWIN_OVER, operand_solid, TWIN_A8,
+	      TWIN_RGB16, _twin_avx2_c_in_a8_over_rgb16),
+    IMPL_MSK (TWIN_FEATURE_AVX2, TWIN_OVER, operand_solid, TWIN_A8,
+	      TWIN_A8, _twin_avx2_c_in_a8_over_a8),
+#endif /* HAVE_AVX2 */
+};
+
+#define NUM_IMPLS   (sizeof (impls) / sizeof (impls[0]))
+
+typedef struct _twin_bilinear_impl {
+    unsigned int	feature;
+    twin_format_t	src;
+    twin_bilinear_func	*fetch;
+} twin_bilinear_impl_t;
+
+static const twin_bilinear_impl_t   bilinear_impls[] = {
+#ifdef HAVE_SSE2
+    { TWIN_FEATURE_SSE2, TWIN_RGB16, _twin_sse2_rgb16_bilinear },
+    { TWIN_FEATURE_SSE2, TWIN_ARGB32, _twin_sse2_argb32_bilinear },
+#endif /* HAVE_SSE2 */
+#ifdef HAVE_AVX2
+    { TWIN_FEATURE_AVX2, TWIN_RGB16, _twin_avx2_rgb16_bilinear },
+    { TWIN_FEATURE_AVX2, TWIN_ARGB32, _twin_avx2_argb32_bilinear },
+#endif /* HAVE_AVX2 */
+};
+
+#define NUM_BILINEAR_IMPLS  (sizeof (bilinear_impls) / \
+			     sizeof (bilinear_impls[0]))
+
+/* the C operators, put back before choosing again */
+static twin_src_op	comp2_c[2][4][3];
+static twin_src_msk_op	comp3_c[2][4][4][3];
+static twin_src_op	fill_c[2][3];
+static twin_bool_t	saved_c;
+
 void
 _twin_draw_set_features(void)
 {
-#ifdef HAVE_ALTIVEC
-    if (twin_has_feature(TWIN_FEATURE_ALTIVEC)) {
-	    comp2[TWIN_SOURCE][TWIN_ARGB32][TWIN_ARGB32] =
-		    _twin_vec_argb32_source_argb32;
-	    comp2[TWIN_OVER][TWIN_ARGB32][TWIN_ARGB32] =
-		    _twin_vec_argb32_over_argb32;
+    const twin_draw_impl_t  *impl;
+    unsigned int	    i;
+
+    bilinear[TWIN_A8] = _twin_a8_bilinear;
+    bilinear[TWIN_RGB16] = _twin_rgb16_bilinear;
+    bilinear[TWIN_ARGB32] = _twin_argb32_bilinear;
+    for (i = 0; i < NUM_BILINEAR_IMPLS; i++)
+	if (twin_has_feature (bilinear_impls[i].feature))
+	    bilinear[bilinear_impls[i].src] = bilinear_impls[i].fetch;
+
+    if (!saved_c)
+    {
+	memcpy (comp2_c, comp2, sizeof (comp2));
+	memcpy (comp3_c, comp3, sizeof (comp3));
+	memcpy (fill_c, fill, sizeof (fill));
+	saved_c = TWIN_TRUE;
+    }
+    memcpy (comp2, comp2_c, sizeof (comp2));
+    memcpy (comp3, comp3_c, sizeof (comp3));
+    memcpy (fill, fill_c, sizeof (fill));
+
+    for (i = 0; i < NUM_IMPLS; i++)
+    {
+	impl = &impls[i];
+	if (!twin_has_feature (impl->feature))
+	    continue;
+	if (impl->msk >= 0)
+	    comp3[impl->operator][impl->src][impl->msk][impl->dst] =
+		impl->msk_op;
+	else
+	{
+	    comp2[impl->operator][impl->src][impl->dst] = impl->op;
+	    if (impl->src == operand_solid)
+		fill[impl->operator][impl->dst] = impl->op;
+	}
     }
-#endif /* HAVE_ALTIVEC */
 }
 
+/*
+ * The operator in use for an unmasked composite, for callers
+ * outside of this file
+ */
+twin_src_op
+_twin_draw_op (twin_operator_t operator, twin_format_t src, twin_format_t dst)
+{
+    return comp2[operator][src][dst];
+}
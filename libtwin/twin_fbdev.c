@@ -43,11 +43,8 @@
 #include "twin_fbdev.h"
 #include "twinint.h"
 
-#ifdef HAVE_ALTIVEC
-#include <altivec.h>
-#endif
-
-#define _IMMEDIATE_REFRESH
+/* Update the screen at most this often (ms) */
+#define TWIN_FBDEV_FRAME_INTERVAL	(1000 / 60)
 
 /* We might want to have more error logging options */
 #define SERROR(fmt...)	do { fprintf(stderr, fmt); \
@@ -62,62 +59,182 @@
 static twin_fbdev_t *twin_fb;
 static int vt_switch_pending;
 
-static void _twin_fbdev_put_span (twin_coord_t    left,
+/* Bytes per pixel, 4 or 2 */
+static int twin_fbdev_cpp(twin_fbdev_t *tf)
+{
+	return tf->fb_var.bits_per_pixel >> 3;
+}
+
+static void _twin_fbdev_put_rect (twin_coord_t    left,
 				  twin_coord_t    top,
 				  twin_coord_t    right,
+				  twin_coord_t    bottom,
 				  twin_argb32_t   *pixels,
+				  twin_coord_t    stride,
 				  void	  	  *closure)
 {
 	twin_fbdev_t    *tf = closure;
-	twin_coord_t    width = right - left;
-	unsigned int	*dest;
+	int		cpp = twin_fbdev_cpp(tf);
+	size_t		len = (right - left) * cpp;
+	char		*src = (char *)pixels;
+	char		*dest;
 
 	if (!tf->active || tf->fb_base == MAP_FAILED)
 		return;
 
-	dest = (unsigned int *)(tf->fb_ptr + top * tf->fb_fix.line_length);
-	dest += left;
-	while(width--)
-		*(dest++) = *(pixels++);
+	if (tf->flipping)
+		twin_region_union_rect(&tf->flip_damage,
+				       left, top, right, bottom);
+
+	dest = tf->fb_back + top * tf->fb_fix.line_length + left * cpp;
+
+	/* composed in place */
+	if (dest == src)
+		return;
+
+	for (; top < bottom; top++) {
+		memcpy(dest, src, len);
+		dest += tf->fb_fix.line_length;
+		src += stride;
+	}
 }
 
-#ifdef HAVE_ALTIVEC
-static void _twin_fbdev_vec_put_span (twin_coord_t    left,
-				      twin_coord_t    top,
-				      twin_coord_t    right,
-				      twin_argb32_t   *pixels,
-				      void     	      *closure)
+static void _twin_fbdev_copy_rect(twin_coord_t left,
+				  twin_coord_t top,
+				  twin_coord_t right,
+				  twin_coord_t bottom,
+				  twin_coord_t dx,
+				  twin_coord_t dy,
+				  void *closure)
 {
-	twin_fbdev_t    	*tf = closure;
-	twin_coord_t    	width = right - left;
-	unsigned int		*dest;
-	vector unsigned char 	edgeperm;
-	vector unsigned char	src0v, src1v, srcv;
+	twin_fbdev_t	*tf = closure;
+	int		cpp = twin_fbdev_cpp(tf);
+	size_t		len = (right - left) * cpp;
+	int		pitch = tf->fb_fix.line_length;
+	char		*src, *dest;
+	int		y;
 
 	if (!tf->active || tf->fb_base == MAP_FAILED)
 		return;
 
-	dest = (unsigned int *)(tf->fb_ptr + top * tf->fb_fix.line_length);
-	dest += left;
-
-	while((((unsigned long)dest) & 0xf) && width--)
-		*(dest++) = *(pixels++);
-
-	edgeperm = vec_lvsl (0, pixels);
-	src0v = vec_ld (0, pixels);
-	while(width >= 4) {
-		src1v = vec_ld (16, pixels);
-		srcv = vec_perm (src0v, src1v, edgeperm);
-		vec_st ((vector unsigned int)srcv, 0, dest);
-		src0v = src1v;
-		dest += 4;
-		pixels += 4;
-		width -= 4;
+	if (tf->flipping)
+		twin_region_union_rect(&tf->flip_damage, left + dx, top + dy,
+				       right + dx, bottom + dy);
+
+	/* Walk away from the destination so rows survive the overlap */
+	for (y = 0; y < bottom - top; y++) {
+		int row = dy > 0 ? bottom - 1 - y : top + y;
+
+		src = tf->fb_back + row * pitch + left * cpp;
+		dest = tf->fb_back + (row + dy) * pitch + (left + dx) * cpp;
+		memmove(dest, src, len);
+	}
+}
+
+static char *twin_fbdev_page(twin_fbdev_t *tf, int page)
+{
+	return tf->fb_ptr + page * tf->fb_var.yres * tf->fb_fix.line_length;
+}
+
+static void _twin_fbdev_begin_frame(void *closure)
+{
+	twin_fbdev_t	*tf = closure;
+	twin_rect_t	*r;
+	char		*front, *back;
+	size_t		off;
+	int		cpp = twin_fbdev_cpp(tf);
+	int		i, y;
+
+	if (!tf->active || !tf->flipping)
+		return;
+
+	/* Bring the back page up to date with the last frame */
+	front = twin_fbdev_page(tf, !tf->back);
+	back = tf->fb_back;
+	for (i = 0; i < tf->flip_damage.nrects; i++) {
+		r = &tf->flip_damage.rects[i];
+		for (y = r->top; y < r->bottom; y++) {
+			off = y * tf->fb_fix.line_length + r->left * cpp;
+			memcpy(back + off, front + off,
+			       (r->right - r->left) * cpp);
+		}
+	}
+	twin_region_init(&tf->flip_damage);
+
+	if (tf->screen->direct)
+		twin_screen_swap_direct(tf->screen, (twin_argb32_t *)back);
+}
+
+static void _twin_fbdev_end_frame(void *closure)
+{
+	twin_fbdev_t	*tf = closure;
+
+	if (!tf->active || !tf->flipping ||
+	    twin_region_is_empty(&tf->flip_damage))
+		return;
+
+	tf->fb_var.yoffset = tf->back * tf->fb_var.yres;
+	if (ioctl(tf->fb_fd, FBIOPAN_DISPLAY, &tf->fb_var) < 0) {
+		SERROR("can't pan display");
+		/* Stop flipping; redraw everything on the visible page
+		 * rather than copy stale pixels over this frame */
+		tf->flipping = 0;
+		tf->back = !tf->back;
+		tf->fb_var.yoffset = tf->back * tf->fb_var.yres;
+		tf->fb_back = twin_fbdev_page(tf, tf->back);
+		twin_region_init(&tf->flip_damage);
+		if (tf->screen->direct)
+			twin_screen_swap_direct(tf->screen,
+						(twin_argb32_t *)tf->fb_back);
+		twin_screen_damage(tf->screen, 0, 0,
+				   tf->screen->width, tf->screen->height);
+		return;
 	}
-	while(width--)
-		*(dest++) = *(pixels++);
+	tf->back = !tf->back;
+	tf->fb_back = twin_fbdev_page(tf, tf->back);
+}
+
+static void twin_fbdev_set_bpp(struct fb_var_screeninfo *var, int bpp)
+{
+	var->bits_per_pixel = bpp;
+	if (bpp == 16) {
+		/* r5g6b5, as twin's RGB16 */
+		var->red.length = 5;
+		var->green.length = 6;
+		var->blue.length = 5;
+		var->transp.length = 0;
+		var->red.offset = 11;
+		var->green.offset = 5;
+		var->blue.offset = 0;
+		var->transp.offset = 0;
+		return;
+	}
+	var->red.length = 8;
+	var->green.length = 8;
+	var->blue.length = 8;
+	var->transp.length = 8;
+	var->red.offset = 0;
+	var->green.offset = 0;
+	var->blue.offset = 0;
+	var->transp.offset = 0;
+}
+
+static twin_bool_t twin_fbdev_is_rgb16(struct fb_var_screeninfo *var)
+{
+	return (var->bits_per_pixel == 16 &&
+		var->red.offset == 11 && var->red.length == 5 &&
+		var->green.offset == 5 && var->green.length == 6 &&
+		var->blue.offset == 0 && var->blue.length == 5);
+}
+
+static int twin_fbdev_put_var(twin_fbdev_t *tf)
+{
+	twin_fbdev_set_bpp(&tf->fb_var, 32);
+	if (ioctl(tf->fb_fd, FBIOPUT_VSCREENINFO, &tf->fb_var) == 0)
+		return 1;
+	twin_fbdev_set_bpp(&tf->fb_var, 16);
+	return ioctl(tf->fb_fd, FBIOPUT_VSCREENINFO, &tf->fb_var) == 0;
 }
-#endif /* HAVE_ALTIVEC */
 
 static twin_bool_t twin_fbdev_apply_config(twin_fbdev_t *tf)
 {
@@ -125,27 +242,31 @@ static twin_bool_t twin_fbdev_apply_config(twin_fbdev_t *tf)
 	struct fb_cmap cmap;
 	size_t len;
 
-	/* Tweak fields to default to 32 bpp argb and virtual == phys */
+	/* Tweak fields to default to 32 bpp argb and virtual == phys,
+	 * settling for r5g6b5 on 16 bpp panels */
 	tf->fb_var.xres_virtual = tf->fb_var.xres;
 	tf->fb_var.yres_virtual = tf->fb_var.yres;
-	tf->fb_var.bits_per_pixel = 32;
-	tf->fb_var.red.length = 8;
-	tf->fb_var.green.length = 8;
-	tf->fb_var.blue.length = 8;
-	tf->fb_var.transp.length = 8;
-	tf->fb_var.red.offset = 0;
-	tf->fb_var.green.offset = 0;
-	tf->fb_var.blue.offset = 0;
-	tf->fb_var.transp.offset = 0;
-
-	/* Apply fbdev settings */
-	if (ioctl(tf->fb_fd, FBIOPUT_VSCREENINFO, &tf->fb_var) < 0) {
-		SERROR("can't set fb mode");
-		return 0;
+	if (tf->double_buffer)
+		tf->fb_var.yres_virtual *= 2;
+	tf->fb_var.xoffset = 0;
+	tf->fb_var.yoffset = 0;
+
+	/* Apply fbdev settings, dropping the second page if the driver
+	 * refuses it; flipping is then left off below */
+	if (!twin_fbdev_put_var(tf)) {
+		if (!tf->double_buffer) {
+			SERROR("can't set fb mode");
+			return 0;
+		}
+		tf->fb_var.yres_virtual = tf->fb_var.yres;
+		if (!twin_fbdev_put_var(tf)) {
+			SERROR("can't set fb mode");
+			return 0;
+		}
 	}
 
 	/* Get new fbdev configuration */
-	if (ioctl(tf->fb_fd, FBIOGET_VSCREENINFO, tf->fb_var) < 0) {
+	if (ioctl(tf->fb_fd, FBIOGET_VSCREENINFO, &tf->fb_var) < 0) {
 		SERROR("can't get framebuffer config");
 		return 0;
 	}
@@ -166,8 +287,9 @@ static twin_bool_t twin_fbdev_apply_config(twin_fbdev_t *tf)
 	      tf->fb_var.transp.length, tf->fb_var.transp.offset);
 
 	/* Check bits per pixel */
-	if (tf->fb_var.bits_per_pixel != 32) {
-		SERROR("can't set fb bpp to 32");
+	if (tf->fb_var.bits_per_pixel != 32 &&
+	    !twin_fbdev_is_rgb16(&tf->fb_var)) {
+		SERROR("can't set fb bpp to 32 or r5g6b5");
 		return 0;
 	}
 
@@ -199,9 +321,45 @@ static twin_bool_t twin_fbdev_apply_config(twin_fbdev_t *tf)
 	}
 	tf->fb_ptr = tf->fb_base + off;
 
+	/* Draw into the hidden page when we can pan to it */
+	tf->flipping = (tf->double_buffer &&
+			tf->fb_var.yres_virtual >= 2 * tf->fb_var.yres &&
+			tf->fb_fix.ypanstep != 0 &&
+			tf->fb_fix.smem_len >= 2 * tf->fb_var.yres *
+			tf->fb_fix.line_length);
+	if (tf->double_buffer && !tf->flipping)
+		DEBUG("fbdev can't pan, drawing to the visible page\n");
+	tf->back = tf->flipping;
+	tf->fb_back = twin_fbdev_page(tf, tf->back);
+	twin_region_init(&tf->flip_damage);
+
 	return 1;
 }
 
+/*
+ * Compose in the framebuffer's depth, straight into the framebuffer
+ * when it holds pixels just like twin does
+ */
+static void twin_fbdev_set_direct(twin_fbdev_t *tf)
+{
+	struct fb_var_screeninfo *var = &tf->fb_var;
+	twin_bool_t rgb16 = twin_fbdev_is_rgb16(var);
+
+	twin_screen_set_format(tf->screen,
+			       rgb16 ? TWIN_RGB16 : TWIN_ARGB32);
+	if ((!rgb16 &&
+	     (var->bits_per_pixel != 32 ||
+	      var->red.offset != 16 || var->red.length != 8 ||
+	      var->green.offset != 8 || var->green.length != 8 ||
+	      var->blue.offset != 0 || var->blue.length != 8)) ||
+	    tf->fb_fix.line_length > 0x7fff) {
+		DEBUG("fbdev layout doesn't match, copying updates\n");
+		return;
+	}
+	twin_screen_set_direct(tf->screen, (twin_argb32_t *)tf->fb_back,
+			       tf->fb_fix.line_length);
+}
+
 static void twin_fbdev_switch(twin_fbdev_t *tf, int activate)
 {
 	tf->vt_active = activate;
@@ -214,14 +372,17 @@ static void twin_fbdev_switch(twin_fbdev_t *tf, int activate)
 		ioctl(tf->vt_fd, VT_RELDISP, VT_ACKACQ);		
 
 		/* Restore fbdev settings */
-		if (twin_fbdev_apply_config(tf)) {
+		if (!tf->active && twin_fbdev_apply_config(tf)) {
 			tf->active = 1;
 
 			/* Mark entire screen for refresh */
-			if (tf->screen)
+			if (tf->screen) {
+				twin_fbdev_set_direct(tf);
 				twin_screen_damage (tf->screen, 0, 0,
 						    tf->screen->width,
 						    tf->screen->height);
+				twin_screen_enable_update(tf->screen);
+			}
 		}
 	} else {
 		/* Allow switch. Maybe we want to expose some option
@@ -229,6 +390,12 @@ static void twin_fbdev_switch(twin_fbdev_t *tf, int activate)
 		 */
 		ioctl(tf->vt_fd, VT_RELDISP, 1);
 
+		/* Stop drawing into the fb before it goes away */
+		if (tf->active && tf->screen) {
+			twin_screen_disable_update(tf->screen);
+			twin_screen_set_direct(tf->screen, NULL, 0);
+		}
+
 		tf->active = 0;
 
 		if (tf->fb_base != MAP_FAILED)
@@ -246,32 +413,9 @@ static twin_bool_t twin_fbdev_work(void *closure)
 		vt_switch_pending = 0;
 	}
 
-#ifndef _IMMEDIATE_REFRESH
-	if (tf->screen && tf->active &&
-	    twin_screen_damaged (tf->screen))
-		twin_screen_update(tf->screen);
-#endif /* _IMMEDIATE_REFRESH */
-
 	return TWIN_TRUE;
 }
 
-#ifdef _IMMEDIATE_REFRESH
-static void twin_fbdev_damaged(void *closure)
-{
-	twin_fbdev_t *tf = closure;
-
-#if 0
-	DEBUG("fbdev damaged %d,%d,%d,%d, active=%d\n",
-	      tf->screen->damage.left, tf->screen->damage.top,
-	      tf->screen->damage.right, tf->screen->damage.bottom,
-	      tf->active);
-#endif
-
-	if (tf->active && twin_screen_damaged (tf->screen))
-		twin_screen_update(tf->screen);
-}
-#endif /* _IMMEDIATE_REFRESH */
-
 static void twin_fbdev_vtswitch(int sig)
 {
 	signal(sig, twin_fbdev_vtswitch);
@@ -469,21 +613,24 @@ static twin_bool_t twin_fbdev_init_fb(twin_fbdev_t *tf)
 
 static twin_bool_t twin_fbdev_init_screen(twin_fbdev_t *tf)
 {
-	twin_put_span_t span;
-
-	span = _twin_fbdev_put_span;
-#ifdef HAVE_ALTIVEC
-	if (twin_has_feature(TWIN_FEATURE_ALTIVEC))
-		span = _twin_fbdev_vec_put_span;
-#endif
-
 	tf->screen = twin_screen_create(tf->fb_var.xres,
 					tf->fb_var.yres,
-					NULL, span, tf);
+					NULL, NULL, tf);
 	if (tf->screen == NULL) {
 		IERROR("can't create twin screen");
 		return 0;
 	}
+	twin_screen_set_put_rect(tf->screen, NULL, _twin_fbdev_put_rect);
+	twin_screen_set_copy_rect(tf->screen, _twin_fbdev_copy_rect);
+	twin_screen_set_put_frame(tf->screen, _twin_fbdev_begin_frame,
+				  _twin_fbdev_end_frame);
+
+	/* Nothing is drawn until the VT is ours */
+	twin_screen_disable_update(tf->screen);
+	twin_screen_set_frame_interval(tf->screen, TWIN_FBDEV_FRAME_INTERVAL);
+
+	/* full screen repaints (e.g. on VT switch) use every CPU */
+	twin_screen_set_threads(tf->screen, 0);
 
 	return 1;
 }
@@ -536,10 +683,6 @@ twin_fbdev_t *twin_fbdev_create(int wanted_vt, int switch_sig)
 	twin_set_work(twin_fbdev_work, TWIN_WORK_REDISPLAY, tf);
 
 	twin_set_file(twin_fbdev_read_events, tf->vt_fd, TWIN_READ, tf);
-
-#ifdef _IMMEDIATE_REFRESH
-	twin_screen_register_damaged(tf->screen, twin_fbdev_damaged, tf);
-#endif
 	twin_fb = tf;
 	return tf;
 
@@ -565,6 +708,11 @@ void twin_fbdev_destroy(twin_fbdev_t *tf)
 	twin_fb = NULL;
 }
 
+void twin_fbdev_set_double_buffer(twin_fbdev_t *tf, int enable)
+{
+	tf->double_buffer = enable;
+}
+
 twin_bool_t twin_fbdev_activate(twin_fbdev_t *tf)
 {
 	/* If VT is not active, try to activate it. We don't deadlock
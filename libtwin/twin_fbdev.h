@@ -50,6 +50,13 @@ typedef struct _twin_fbdev {
 	size_t		fb_len;
 	char		*fb_ptr;
 
+	/* page flipping */
+	int		double_buffer;	/* wanted */
+	int		flipping;	/* two pages available */
+	int		back;		/* page being drawn */
+	char		*fb_back;
+	twin_region_t	flip_damage;	/* drawn since the last flip */
+
 } twin_fbdev_t;
 
 /**
@@ -66,8 +73,9 @@ typedef struct _twin_fbdev {
  * to change them though they will only be applied if the fbdev is
  * frontmost or when it is activated.
  *
- * Note that this implementation only supports 32bpp argb though it
- * shouldn't be too hard to change that.
+ * Note that this implementation only supports 32bpp argb and 16bpp
+ * r5g6b5; the latter is used when the fbdev refuses 32bpp, and the
+ * screen is then composed in TWIN_RGB16.
  *
  * Regarding the signal passed in switch_sig, it's the responsibility
  * of the caller to make sure it's not blocked.
@@ -92,5 +100,22 @@ void twin_fbdev_destroy(twin_fbdev_t *tf);
  */
 twin_bool_t twin_fbdev_activate(twin_fbdev_t *tf);
 
+/**
+ * twin_fbdev_set_double_buffer - draw off screen and flip pages
+ * @tf: backend pointer
+ * @enable: true to flip between two pages
+ *
+ * Asks the fbdev for a virtual resolution twice the screen height.
+ * Each frame is composed into the hidden page, which is then
+ * panned into view, so partial updates are never visible. Areas
+ * drawn in one frame are copied into the other page before the
+ * next, keeping both pages identical.
+ *
+ * Like other settings, this is applied when the fbdev is next
+ * activated. Drivers which can't pan keep drawing to the visible
+ * page.
+ */
+void twin_fbdev_set_double_buffer(twin_fbdev_t *tf, int enable);
+
 
 #endif /* _TWIN_FBDEV_H_ */
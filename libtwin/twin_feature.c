@@ -19,6 +19,7 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#include <stdio.h>
 #include <signal.h>
 #include <setjmp.h>
 
@@ -55,9 +56,98 @@ static int _twin_have_altivec(void)
 }
 
 #else
-#define _twin_have_altivec()
+#define _twin_have_altivec() 0
 #endif /* HAVE_ALTIVEC */
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+#include <cpuid.h>
+
+static unsigned int _twin_xgetbv(void)
+{
+	unsigned int eax, edx;
+
+	asm volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return eax;
+}
+
+static unsigned int _twin_have_x86(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int features = 0;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if (edx & bit_SSE2)
+		features |= TWIN_FEATURE_SSE2;
+	if (ecx & bit_SSSE3)
+		features |= TWIN_FEATURE_SSSE3;
+	if (ecx & bit_SSE4_1)
+		features |= TWIN_FEATURE_SSE41;
+
+	/* AVX registers are only usable if the OS saves them */
+	if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) ||
+	    (_twin_xgetbv() & 0x6) != 0x6)
+		return features;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return features;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (ebx & bit_AVX2)
+		features |= TWIN_FEATURE_AVX2;
+	return features;
+}
+
+#else
+#define _twin_have_x86() 0
+#endif /* x86 */
+
+/*
+ * Tiers which TWIN_FEATURES can force; the generic vector kernels
+ * stay available under each of the SIMD ones
+ */
+#define TWIN_TIER_SSE2	(TWIN_FEATURE_VECTOR | TWIN_FEATURE_SSE2)
+#define TWIN_TIER_SSSE3	(TWIN_TIER_SSE2 | TWIN_FEATURE_SSSE3)
+#define TWIN_TIER_SSE41	(TWIN_TIER_SSSE3 | TWIN_FEATURE_SSE41)
+#define TWIN_TIER_AVX2	(TWIN_TIER_SSE41 | TWIN_FEATURE_AVX2)
+
+static const struct {
+	const char	*name;
+	unsigned int	features;
+} _twin_feature_tiers[] = {
+	{ "c",		0 },
+	{ "vector",	TWIN_FEATURE_VECTOR },
+	{ "altivec",	TWIN_FEATURE_VECTOR | TWIN_FEATURE_ALTIVEC },
+	{ "sse2",	TWIN_TIER_SSE2 },
+	{ "ssse3",	TWIN_TIER_SSSE3 },
+	{ "sse4.1",	TWIN_TIER_SSE41 },
+	{ "avx2",	TWIN_TIER_AVX2 },
+};
+
+#define NUM_TIERS (sizeof(_twin_feature_tiers) / sizeof(_twin_feature_tiers[0]))
+
+/*
+ * TWIN_FEATURES must be spelled exactly as a name above: c, vector,
+ * altivec, sse2, ssse3, sse4.1 or avx2.  Anything else is reported and
+ * treated as c, so a typo can't pass the detected set off as a tier.
+ */
+static unsigned int _twin_feature_override(unsigned int features)
+{
+	const char *tier = getenv("TWIN_FEATURES");
+	unsigned int i;
+
+	if (!tier)
+		return features;
+	for (i = 0; i < NUM_TIERS; i++)
+		if (!strcmp(tier, _twin_feature_tiers[i].name))
+			return features & _twin_feature_tiers[i].features;
+	fprintf(stderr, "twin: unknown TWIN_FEATURES \"%s\", using c;"
+		" expected one of", tier);
+	for (i = 0; i < NUM_TIERS; i++)
+		fprintf(stderr, " %s", _twin_feature_tiers[i].name);
+	fprintf(stderr, "\n");
+	return 0;
+}
+
 int twin_has_feature(unsigned int feature)
 {
 	return (_twin_features & feature) != 0;
@@ -65,8 +155,14 @@ int twin_has_feature(unsigned int feature)
 
 void twin_feature_init(void)
 {
+	unsigned int features = _twin_have_x86();
+
 	if (_twin_have_altivec())
-		_twin_features |= TWIN_FEATURE_ALTIVEC;
+		features |= TWIN_FEATURE_ALTIVEC;
+#ifdef HAVE_VECTOR
+	features |= TWIN_FEATURE_VECTOR;
+#endif
+	_twin_features = _twin_feature_override(features);
 
 	_twin_draw_set_features();
 }
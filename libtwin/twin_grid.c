@@ -0,0 +1,244 @@
+/*
+ * Twin - A Tiny Window System
+ * Copyright © 2004 Keith Packard <keithp@keithp.com>
+ * All rights reserved.
+ *
+ * This Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with the Twin Library; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "twinint.h"
+
+/*
+ * Shown pixmaps are indexed by a grid of square cells over the
+ * screen.  Each cell lists the pixmaps touching it, topmost first,
+ * so finding the pixmap under a point only looks at those few.
+ * Pixmaps carry their position in the stack to keep the lists
+ * ordered; that's renumbered whenever a pixmap is shown.
+ */
+
+#define TWIN_GRID_SHIFT	6	/* 64 pixel cells */
+
+typedef struct _twin_grid_cell {
+    twin_pixmap_t   **pixmaps;
+    int		    n, size;
+} twin_grid_cell_t;
+
+struct _twin_grid {
+    twin_coord_t	cols, rows;
+    twin_grid_cell_t	*cells;
+};
+
+static void
+_twin_grid_destroy (twin_grid_t *grid)
+{
+    int	i;
+
+    for (i = 0; i < grid->cols * grid->rows; i++)
+	free (grid->cells[i].pixmaps);
+    free (grid);
+}
+
+/*
+ * Drop the index when it can't be kept up to date; lookups then
+ * walk the stack instead
+ */
+static void
+_twin_grid_fail (twin_screen_t *screen)
+{
+    _twin_grid_destroy (screen->grid);
+    screen->grid = NULL;
+}
+
+/*
+ * Cells covered by the pixmap, returns FALSE if it's off screen
+ */
+static twin_bool_t
+_twin_grid_span (twin_grid_t *grid, twin_pixmap_t *pixmap,
+		 twin_coord_t *left, twin_coord_t *top,
+		 twin_coord_t *right, twin_coord_t *bottom)
+{
+    int	l = pixmap->x >> TWIN_GRID_SHIFT;
+    int	t = pixmap->y >> TWIN_GRID_SHIFT;
+    int	r = (pixmap->x + pixmap->width - 1) >> TWIN_GRID_SHIFT;
+    int	b = (pixmap->y + pixmap->height - 1) >> TWIN_GRID_SHIFT;
+
+    if (pixmap->width <= 0 || pixmap->height <= 0)
+	return TWIN_FALSE;
+    if (l < 0)
+	l = 0;
+    if (t < 0)
+	t = 0;
+    if (r >= grid->cols)
+	r = grid->cols - 1;
+    if (b >= grid->rows)
+	b = grid->rows - 1;
+    if (l > r || t > b)
+	return TWIN_FALSE;
+    *left = l;
+    *top = t;
+    *right = r;
+    *bottom = b;
+    return TWIN_TRUE;
+}
+
+static twin_bool_t
+_twin_grid_cell_insert (twin_grid_cell_t *cell, twin_pixmap_t *pixmap)
+{
+    int	i;
+
+    if (cell->n == cell->size)
+    {
+	int		size = cell->size ? cell->size * 2 : 4;
+	twin_pixmap_t	**pixmaps = realloc (cell->pixmaps,
+					     size * sizeof (twin_pixmap_t *));
+	if (!pixmaps)
+	    return TWIN_FALSE;
+	cell->pixmaps = pixmaps;
+	cell->size = size;
+    }
+    for (i = 0; i < cell->n; i++)
+	if (cell->pixmaps[i]->stack < pixmap->stack)
+	    break;
+    memmove (&cell->pixmaps[i + 1], &cell->pixmaps[i],
+	     (cell->n - i) * sizeof (twin_pixmap_t *));
+    cell->pixmaps[i] = pixmap;
+    cell->n++;
+    return TWIN_TRUE;
+}
+
+static void
+_twin_grid_cell_remove (twin_grid_cell_t *cell, twin_pixmap_t *pixmap)
+{
+    int	i;
+
+    for (i = 0; i < cell->n; i++)
+	if (cell->pixmaps[i] == pixmap)
+	{
+	    memmove (&cell->pixmaps[i], &cell->pixmaps[i + 1],
+		     (cell->n - i - 1) * sizeof (twin_pixmap_t *));
+	    cell->n--;
+	    return;
+	}
+}
+
+void
+_twin_grid_insert (twin_screen_t *screen, twin_pixmap_t *pixmap)
+{
+    twin_grid_t	    *grid = screen->grid;
+    twin_coord_t    left, top, right, bottom, x, y;
+
+    if (!grid || !_twin_grid_span (grid, pixmap, &left, &top, &right, &bottom))
+	return;
+    for (y = top; y <= bottom; y++)
+	for (x = left; x <= right; x++)
+	    if (!_twin_grid_cell_insert (&grid->cells[y * grid->cols + x],
+					 pixmap))
+	    {
+		_twin_grid_fail (screen);
+		return;
+	    }
+}
+
+void
+_twin_grid_remove (twin_screen_t *screen, twin_pixmap_t *pixmap)
+{
+    twin_grid_t	    *grid = screen->grid;
+    twin_coord_t    left, top, right, bottom, x, y;
+
+    if (!grid || !_twin_grid_span (grid, pixmap, &left, &top, &right, &bottom))
+	return;
+    for (y = top; y <= bottom; y++)
+	for (x = left; x <= right; x++)
+	    _twin_grid_cell_remove (&grid->cells[y * grid->cols + x], pixmap);
+}
+
+/*
+ * Number the stack from the bottom.  The relative order of the
+ * pixmaps already indexed doesn't change, so the cells stay sorted
+ */
+void
+_twin_grid_restack (twin_screen_t *screen)
+{
+    twin_pixmap_t   *p;
+    twin_count_t    stack = 0;
+
+    for (p = screen->bottom; p; p = p->up)
+	p->stack = stack++;
+}
+
+/*
+ * (Re)build the index for the current screen size
+ */
+void
+_twin_grid_resize (twin_screen_t *screen)
+{
+    twin_grid_t	    *grid;
+    twin_coord_t    cols, rows;
+    twin_pixmap_t   *p;
+
+    if (screen->grid)
+	_twin_grid_destroy (screen->grid);
+    screen->grid = NULL;
+
+    cols = (screen->width + (1 << TWIN_GRID_SHIFT) - 1) >> TWIN_GRID_SHIFT;
+    rows = (screen->height + (1 << TWIN_GRID_SHIFT) - 1) >> TWIN_GRID_SHIFT;
+    if (cols <= 0 || rows <= 0)
+	return;
+    grid = calloc (1, sizeof (twin_grid_t) +
+		   cols * rows * sizeof (twin_grid_cell_t));
+    if (!grid)
+	return;
+    grid->cols = cols;
+    grid->rows = rows;
+    grid->cells = (twin_grid_cell_t *) (grid + 1);
+    screen->grid = grid;
+
+    for (p = screen->bottom; p; p = p->up)
+	_twin_grid_insert (screen, p);
+}
+
+void
+_twin_grid_fini (twin_screen_t *screen)
+{
+    if (screen->grid)
+	_twin_grid_fail (screen);
+}
+
+/*
+ * Topmost pixmap with a visible pixel at x, y
+ */
+twin_pixmap_t *
+_twin_grid_lookup (twin_screen_t *screen, twin_coord_t x, twin_coord_t y)
+{
+    twin_grid_t	    *grid = screen->grid;
+    twin_grid_cell_t	*cell;
+    twin_pixmap_t   *p;
+    int		    i;
+
+    if (!grid || x < 0 || y < 0 || x >= screen->width || y >= screen->height)
+    {
+	for (p = screen->top; p; p = p->down)
+	    if (!twin_pixmap_transparent (p, x, y))
+		return p;
+	return NULL;
+    }
+    cell = &grid->cells[(y >> TWIN_GRID_SHIFT) * grid->cols +
+			(x >> TWIN_GRID_SHIFT)];
+    for (i = 0; i < cell->n; i++)
+	if (!twin_pixmap_transparent (cell->pixmaps[i], x, y))
+	    return cell->pixmaps[i];
+    return NULL;
+}
@@ -524,6 +524,82 @@ twin_path_destroy (twin_path_t *path)
     free (path);
 }
 
+/*
+ * Rows of path coverage on their way to the destination
+ */
+typedef struct _twin_path_rows {
+    twin_pixmap_t   *dst;
+    twin_coord_t    dst_x, dst_y;
+    twin_operand_t  *src;
+    twin_coord_t    src_x, src_y;
+    twin_a8_t	    *cover;
+    twin_extent_t   *rows;
+    twin_rect_t	    damage;
+} twin_path_rows_t;
+
+/*
+ * Coverage is checked a block at a time; an empty block splits the
+ * row so long gaps, like the inside of a stroked outline, never
+ * touch the destination
+ */
+#define TWIN_COVER_BLOCK	((twin_coord_t) (4 * sizeof (uint64_t)))
+
+static twin_bool_t
+_twin_cover_empty (const twin_a8_t *cover, twin_coord_t x)
+{
+    uint64_t	w[4];
+
+    memcpy (w, cover + x, sizeof (w));
+    return (w[0] | w[1] | w[2] | w[3]) == 0;
+}
+
+static void
+_twin_path_row_done (twin_coord_t y, void *closure)
+{
+    twin_path_rows_t	*r = closure;
+    twin_a8_t		*cover = r->cover;
+    twin_extent_t	*e = &r->rows[y];
+    twin_coord_t	x, left;
+
+    if (e->left >= e->right)
+	return;
+    x = e->left;
+    while (x < e->right)
+    {
+	while (x + TWIN_COVER_BLOCK <= e->right && _twin_cover_empty (cover, x))
+	    x += TWIN_COVER_BLOCK;
+	while (x < e->right && !cover[x])
+	    x++;
+	left = x;
+	while (x + TWIN_COVER_BLOCK <= e->right && !_twin_cover_empty (cover, x))
+	    x += TWIN_COVER_BLOCK;
+	if (x + TWIN_COVER_BLOCK > e->right)
+	    x = e->right;
+	if (left >= x)
+	    break;
+	_twin_composite_span (r->dst, r->dst_x + left, r->dst_y + y,
+			      r->src, r->src_x + left, r->src_y + y,
+			      cover + left, TWIN_OVER, x - left);
+	/* the gaps are already clear */
+	memset (cover + left, '\0', x - left);
+    }
+    if (r->damage.left >= r->damage.right)
+    {
+	r->damage.left = e->left;
+	r->damage.right = e->right;
+	r->damage.top = y;
+    }
+    else
+    {
+	if (e->left < r->damage.left)
+	    r->damage.left = e->left;
+	if (e->right > r->damage.right)
+	    r->damage.right = e->right;
+    }
+    r->damage.bottom = y + 1;
+    e->right = e->left;
+}
+
 void
 twin_composite_path (twin_pixmap_t	*dst,
 		     twin_operand_t	*src,
@@ -534,18 +610,85 @@ twin_composite_path (twin_pixmap_t	*dst,
 {
     twin_rect_t	    bounds;
     twin_pixmap_t   *mask;
+    twin_pixmap_t   line;
     twin_operand_t  msk;
     twin_coord_t    width, height;
+    twin_path_rows_t	r;
+    twin_pointer_t  cover;
+    twin_coord_t    y;
 
     twin_path_bounds (path, &bounds);
     if (bounds.left >= bounds.right || bounds.top >= bounds.bottom)
 	return;
     width = bounds.right - bounds.left;
     height = bounds.bottom - bounds.top;
+
+    /* rectangles and the like go straight to fills */
+    if (operator == TWIN_OVER &&
+	_twin_rect_composite_path (dst, src, src_x, src_y, path, &bounds))
+	return;
+
+    /*
+     * With OVER, pixels the path misses are left alone, so each row
+     * can be composited as the rasterizer finishes it, through one
+     * row of coverage, instead of filling a whole mask first
+     */
+    if (operator == TWIN_OVER &&
+	(src->source_kind == TWIN_SOLID ||
+	 twin_matrix_is_identity (&src->u.pixmap->transform)))
+    {
+	r.rows = _twin_scratch_alloc (TWIN_SCRATCH_PATH,
+				      height * sizeof (twin_extent_t) + width);
+	if (!r.rows)
+	    return;
+	r.cover = (twin_a8_t *) (r.rows + height);
+	memset (r.cover, '\0', width);
+	for (y = 0; y < height; y++)
+	{
+	    r.rows[y].left = width;
+	    r.rows[y].right = 0;
+	}
+	r.dst = dst;
+	r.dst_x = bounds.left;
+	r.dst_y = bounds.top;
+	r.src = src;
+	r.src_x = src_x + bounds.left;
+	r.src_y = src_y + bounds.top;
+	r.damage.left = r.damage.right = 0;
+
+	/* every row shares the one line of coverage */
+	cover.a8 = r.cover;
+	_twin_pixmap_init (&line, TWIN_A8, width, height, 0, cover);
+	line.antialias = dst->antialias;
+
+	/* and only the part inside the destination clip is drawn */
+	if (line.clip.left < dst->clip.left - dst->origin_x - bounds.left)
+	    line.clip.left = dst->clip.left - dst->origin_x - bounds.left;
+	if (line.clip.top < dst->clip.top - dst->origin_y - bounds.top)
+	    line.clip.top = dst->clip.top - dst->origin_y - bounds.top;
+	if (line.clip.right > dst->clip.right - dst->origin_x - bounds.left)
+	    line.clip.right = dst->clip.right - dst->origin_x - bounds.left;
+	if (line.clip.bottom > dst->clip.bottom - dst->origin_y - bounds.top)
+	    line.clip.bottom = dst->clip.bottom - dst->origin_y - bounds.top;
+	if (line.clip.left >= line.clip.right ||
+	    line.clip.top >= line.clip.bottom)
+	    return;
+
+	_twin_fill_path (&line, path, -bounds.left, -bounds.top, r.rows,
+			 _twin_path_row_done, &r);
+	if (r.damage.left < r.damage.right)
+	    twin_pixmap_damage (dst,
+				r.damage.left + bounds.left + dst->origin_x,
+				r.damage.top + bounds.top + dst->origin_y,
+				r.damage.right + bounds.left + dst->origin_x,
+				r.damage.bottom + bounds.top + dst->origin_y);
+	return;
+    }
+
     mask = twin_pixmap_create (TWIN_A8, width, height);
-			       
     if (!mask)
 	return;
+    mask->antialias = dst->antialias;
     twin_fill_path (mask, path, -bounds.left, -bounds.top);
     msk.source_kind = TWIN_PIXMAP;
     msk.u.pixmap = mask;
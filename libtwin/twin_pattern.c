@@ -30,12 +30,16 @@ twin_pixmap_t *
 twin_make_pattern (void)
 {
     twin_pointer_t	pixels;
+    twin_pixmap_t	*pattern;
 
     pixels.v = (void *) cork_image.pixel_data;
 
-    return twin_pixmap_create_const (TWIN_ARGB32,
-				     cork_image.width,
-				     cork_image.height,
-				     cork_image.width * cork_image.bytes_per_pixel,
-				     pixels);
+    pattern = twin_pixmap_create_const (TWIN_ARGB32,
+					cork_image.width,
+					cork_image.height,
+					cork_image.width * cork_image.bytes_per_pixel,
+					pixels);
+    if (pattern)
+	twin_pixmap_set_extend (pattern, TWIN_EXTEND_REPEAT);
+    return pattern;
 }
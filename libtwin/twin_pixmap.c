@@ -21,32 +21,51 @@
 
 #include "twinint.h"
 
-twin_pixmap_t *
-twin_pixmap_create (twin_format_t   format,
-		    twin_coord_t    width,
-		    twin_coord_t    height)
+void
+_twin_pixmap_init (twin_pixmap_t    *pixmap,
+		   twin_format_t    format,
+		   twin_coord_t	    width,
+		   twin_coord_t	    height,
+		   twin_coord_t	    stride,
+		   twin_pointer_t   pixels)
 {
-    twin_coord_t    stride = twin_bytes_per_pixel (format) * width;
-    twin_area_t	    space = (twin_area_t) stride * height;
-    twin_area_t	    size = sizeof (twin_pixmap_t) + space;
-    twin_pixmap_t   *pixmap = malloc (size);
-    if (!pixmap)
-	return 0;
     pixmap->screen = 0;
     pixmap->up = 0;
     pixmap->down = 0;
+    pixmap->stack = 0;
     pixmap->x = pixmap->y = 0;
     pixmap->format = format;
     pixmap->width = width;
     pixmap->height = height;
     twin_matrix_identity(&pixmap->transform);
+    pixmap->filter = TWIN_FILTER_BILINEAR;
+    pixmap->extend = TWIN_EXTEND_NONE;
+    pixmap->antialias = TWIN_ANTIALIAS_DEFAULT;
     pixmap->clip.left = pixmap->clip.top = 0;
     pixmap->clip.right = pixmap->width;
     pixmap->clip.bottom = pixmap->height;
     pixmap->origin_x = pixmap->origin_y = 0;
     pixmap->stride = stride;
+    pixmap->opaque = format == TWIN_RGB16;
     pixmap->disable = 0;
-    pixmap->p.v = pixmap + 1;
+    pixmap->p = pixels;
+}
+
+twin_pixmap_t *
+twin_pixmap_create (twin_format_t   format,
+		    twin_coord_t    width,
+		    twin_coord_t    height)
+{
+    twin_coord_t    stride = twin_bytes_per_pixel (format) * width;
+    twin_area_t	    space = (twin_area_t) stride * height;
+    twin_area_t	    size = sizeof (twin_pixmap_t) + space;
+    twin_pixmap_t   *pixmap = malloc (size);
+    twin_pointer_t  pixels;
+
+    if (!pixmap)
+	return 0;
+    pixels.v = pixmap + 1;
+    _twin_pixmap_init (pixmap, format, width, height, stride, pixels);
     memset (pixmap->p.v, '\0', space);
     return pixmap;
 }
@@ -61,21 +80,7 @@ twin_pixmap_create_const (twin_format_t	    format,
     twin_pixmap_t   *pixmap = malloc (sizeof (twin_pixmap_t));
     if (!pixmap)
 	return 0;
-    pixmap->screen = 0;
-    pixmap->up = 0;
-    pixmap->down = 0;
-    pixmap->x = pixmap->y = 0;
-    pixmap->format = format;
-    pixmap->width = width;
-    pixmap->height = height;
-    twin_matrix_identity(&pixmap->transform);
-    pixmap->clip.left = pixmap->clip.top = 0;
-    pixmap->clip.right = pixmap->width;
-    pixmap->clip.bottom = pixmap->height;
-    pixmap->origin_x = pixmap->origin_y = 0;
-    pixmap->stride = stride;
-    pixmap->disable = 0;
-    pixmap->p = pixels;
+    _twin_pixmap_init (pixmap, format, width, height, stride, pixels);
     return pixmap;
 }
 
@@ -110,6 +115,8 @@ twin_pixmap_show (twin_pixmap_t	*pixmap,
 	lower->up = pixmap;
 	if (!pixmap->up)
 	    screen->top = pixmap;
+	else
+	    pixmap->up->down = pixmap;
     }
     else
     {
@@ -118,11 +125,72 @@ twin_pixmap_show (twin_pixmap_t	*pixmap,
 	screen->bottom = pixmap;
 	if (!pixmap->up)
 	    screen->top = pixmap;
+	else
+	    pixmap->up->down = pixmap;
     }
 
+    _twin_grid_restack (screen);
+    _twin_grid_insert (screen, pixmap);
+
     twin_pixmap_damage (pixmap, 0, 0, pixmap->width, pixmap->height);
 }
 
+void
+twin_pixmap_set_opaque (twin_pixmap_t *pixmap, twin_bool_t opaque)
+{
+    if (pixmap->opaque == opaque)
+	return;
+    pixmap->opaque = opaque;
+    twin_pixmap_damage (pixmap, 0, 0, pixmap->width, pixmap->height);
+}
+
+/*
+ * Choose how the pixmap is sampled when composited through
+ * a transform
+ */
+void
+twin_pixmap_set_filter (twin_pixmap_t *pixmap, twin_filter_t filter)
+{
+    pixmap->filter = filter;
+}
+
+twin_filter_t
+twin_pixmap_get_filter (twin_pixmap_t *pixmap)
+{
+    return pixmap->filter;
+}
+
+/*
+ * Choose what the pixmap shows outside its clip when used as a
+ * source
+ */
+void
+twin_pixmap_set_extend (twin_pixmap_t *pixmap, twin_extend_t extend)
+{
+    pixmap->extend = extend;
+}
+
+twin_extend_t
+twin_pixmap_get_extend (twin_pixmap_t *pixmap)
+{
+    return pixmap->extend;
+}
+
+/*
+ * Choose how finely paths drawn into the pixmap are sampled
+ */
+void
+twin_pixmap_set_antialias (twin_pixmap_t *pixmap, twin_antialias_t antialias)
+{
+    pixmap->antialias = antialias;
+}
+
+twin_antialias_t
+twin_pixmap_get_antialias (twin_pixmap_t *pixmap)
+{
+    return pixmap->antialias;
+}
+
 void
 twin_pixmap_hide (twin_pixmap_t *pixmap)
 {
@@ -133,6 +201,8 @@ twin_pixmap_hide (twin_pixmap_t *pixmap)
 	return;
 
     twin_pixmap_damage (pixmap, 0, 0, pixmap->width, pixmap->height);
+    _twin_screen_drop_copy (screen, pixmap);
+    _twin_grid_remove (screen, pixmap);
 
     if (pixmap->up)
 	down = &pixmap->up->down;
@@ -330,10 +400,27 @@ twin_pixmap_transparent (twin_pixmap_t *pixmap, twin_coord_t x, twin_coord_t y)
 void
 twin_pixmap_move (twin_pixmap_t *pixmap, twin_coord_t x, twin_coord_t y)
 {
-    twin_pixmap_damage (pixmap, 0, 0, pixmap->width, pixmap->height);
+    twin_screen_t   *screen = pixmap->screen;
+    twin_bool_t	    copy = TWIN_FALSE;
+
+    if (screen)
+    {
+	twin_screen_disable_update (screen);
+	/* shift what's on the screen rather than compose it again */
+	copy = _twin_screen_copy_pixmap (screen, pixmap);
+    }
+    if (!copy)
+	twin_pixmap_damage (pixmap, 0, 0, pixmap->width, pixmap->height);
+    if (screen)
+	_twin_grid_remove (screen, pixmap);
     pixmap->x = x;
     pixmap->y = y;
-    twin_pixmap_damage (pixmap, 0, 0, pixmap->width, pixmap->height);
+    if (screen)
+	_twin_grid_insert (screen, pixmap);
+    if (!copy)
+	twin_pixmap_damage (pixmap, 0, 0, pixmap->width, pixmap->height);
+    if (screen)
+	twin_screen_enable_update (screen);
 }
 
 twin_bool_t
@@ -21,55 +21,61 @@
 
 #include "twinint.h"
 	    
-typedef struct _twin_edge {
-    struct _twin_edge	*next;
-    twin_sfixed_t	top, bot;
-    twin_sfixed_t	x;
-    twin_sfixed_t	e;
-    twin_sfixed_t	dx, dy;
-    twin_sfixed_t	inc_x;
-    twin_sfixed_t	step_x;
-    int			winding;
-} twin_edge_t;
-
-#define TWIN_POLY_SHIFT	    2
-#define TWIN_POLY_FIXED_SHIFT	(4 - TWIN_POLY_SHIFT)
-#define TWIN_POLY_SAMPLE    (1 << TWIN_POLY_SHIFT)
-#define TWIN_POLY_MASK	    (TWIN_POLY_SAMPLE - 1)
-#define TWIN_POLY_STEP	    (TWIN_SFIXED_ONE >> TWIN_POLY_SHIFT)
-#define TWIN_POLY_START	    (TWIN_POLY_STEP >> 1)
-#define TWIN_POLY_CEIL(c)   (((c) + (TWIN_POLY_STEP-1)) & ~(TWIN_POLY_STEP-1))
-#define TWIN_POLY_COL(x)    (((x) >> TWIN_POLY_FIXED_SHIFT) & TWIN_POLY_MASK)
-
-static int
-_edge_compare_y (const void *a, const void *b)
-{
-    const twin_edge_t	*ae = a;
-    const twin_edge_t	*be = b;
+/*
+ * Edges are stored as a structure of arrays so that stepping the
+ * active edges down a row only touches the fields it needs
+ */
+typedef struct _twin_edges {
+    int			n;
+    twin_sfixed_t	*top, *bot;
+    twin_sfixed_t	*x;
+    twin_sfixed_t	*e;
+    twin_sfixed_t	*dx, *dy;
+    twin_sfixed_t	*inc_x;
+    twin_sfixed_t	*step_x;
+    int			*winding;
+} twin_edges_t;
 
-    return (int) (ae->top - be->top);
-}
+/*
+ * The sample grid is 1 << shift samples on a side for each pixel,
+ * with shift chosen by the pixmap's antialias mode
+ */
+#define TWIN_POLY_FIXED_SHIFT(s)    (4 - (s))
+#define TWIN_POLY_SAMPLE(s)	    (1 << (s))
+#define TWIN_POLY_MASK(s)	    (TWIN_POLY_SAMPLE(s) - 1)
+#define TWIN_POLY_STEP(s)	    (TWIN_SFIXED_ONE >> (s))
+#define TWIN_POLY_START(s)	    (TWIN_POLY_STEP(s) >> 1)
+
+/* the fill below is expanded once for each grid */
+#ifdef __GNUC__
+#define TWIN_POLY_INLINE	    inline __attribute__((always_inline))
+#else
+#define TWIN_POLY_INLINE	    inline
+#endif
 
 static void
-_edge_step_by (twin_edge_t  *edge, twin_sfixed_t dy)
+_edge_step_by (twin_edges_t *edges, int i, twin_sfixed_t dy)
 {
     twin_dfixed_t   e;
     
-    e = edge->e + (twin_dfixed_t) dy * edge->dx;
-    edge->x += edge->step_x * dy + edge->inc_x * (e / edge->dy);
-    edge->e = e % edge->dy;
+    e = edges->e[i] + (twin_dfixed_t) dy * edges->dx[i];
+    edges->x[i] += edges->step_x[i] * dy + edges->inc_x[i] * (e / edges->dy[i]);
+    edges->e[i] = e % edges->dy[i];
 }
 
 /*
  * Returns the nearest grid coordinate no less than f
  *
- * Grid coordinates are at TWIN_POLY_STEP/2 + n*TWIN_POLY_STEP
+ * Grid coordinates are at TWIN_POLY_STEP/2 + n*TWIN_POLY_STEP; with
+ * 16 samples a step is the smallest sfixed unit and there is no
+ * half step, so they land on each one
  */
 
-static twin_sfixed_t
-_twin_sfixed_grid_ceil (twin_sfixed_t f)
+static TWIN_POLY_INLINE twin_sfixed_t
+_twin_sfixed_grid_ceil (twin_sfixed_t f, int shift)
 {
-    return ((f + (TWIN_POLY_START - 1)) & ~(TWIN_POLY_STEP - 1)) + TWIN_POLY_START;
+    return ((f + (TWIN_POLY_STEP(shift) - 1 - TWIN_POLY_START(shift))) &
+	    ~(TWIN_POLY_STEP(shift) - 1)) + TWIN_POLY_START(shift);
 }
 
 #if 0
@@ -80,16 +86,17 @@ _twin_sfixed_grid_ceil (twin_sfixed_t f)
 #define DBGOUT(x...)
 #endif
 
-static int
-_twin_edge_build (twin_spoint_t *vertices, int nvertices, twin_edge_t *edges,
-		  twin_sfixed_t dx, twin_sfixed_t dy, twin_sfixed_t top_y)
+static void
+_twin_edge_build (twin_spoint_t *vertices, int nvertices, twin_edges_t *edges,
+		  twin_sfixed_t dx, twin_sfixed_t dy,
+		  twin_sfixed_t top_y, twin_sfixed_t bot_y, int shift)
 {
     int		    v, nv;
     int		    tv, bv;
     int		    e;
     twin_sfixed_t   y;
 
-    e = 0;
+    e = edges->n;
     for (v = 0; v < nvertices; v++)
     {
 	nv = v + 1;
@@ -104,96 +111,104 @@ _twin_edge_build (twin_spoint_t *vertices, int nvertices, twin_edge_t *edges,
 	/* figure winding */
 	if (vertices[v].y < vertices[nv].y)
 	{
-	    edges[e].winding = 1;
+	    edges->winding[e] = 1;
 	    tv = v;
 	    bv = nv;
 	}
 	else
 	{
-	    edges[e].winding = -1;
+	    edges->winding[e] = -1;
 	    tv = nv;
 	    bv = v;
 	}
 
 	/* snap top to first grid point in pixmap */
-	y = _twin_sfixed_grid_ceil (vertices[tv].y + dy);
-	if (y < TWIN_POLY_START + top_y)
-	    y = TWIN_POLY_START + top_y;
+	y = _twin_sfixed_grid_ceil (vertices[tv].y + dy, shift);
+	if (y < TWIN_POLY_START(shift) + top_y)
+	    y = TWIN_POLY_START(shift) + top_y;
 	
 	/* skip vertices which don't span a sample row */
 	if (y >= vertices[bv].y + dy)
 	    continue;
 
+	/* and those starting below the pixmap */
+	if (y >= bot_y)
+	    continue;
+
 	/* Compute bresenham terms */
-	edges[e].dx = vertices[bv].x - vertices[tv].x;
-	edges[e].dy = vertices[bv].y - vertices[tv].y;
-	if (edges[e].dx >= 0)
-	    edges[e].inc_x = 1;
+	edges->dx[e] = vertices[bv].x - vertices[tv].x;
+	edges->dy[e] = vertices[bv].y - vertices[tv].y;
+	if (edges->dx[e] >= 0)
+	    edges->inc_x[e] = 1;
 	else
 	{
-	    edges[e].inc_x = -1;
-	    edges[e].dx = -edges[e].dx;
+	    edges->inc_x[e] = -1;
+	    edges->dx[e] = -edges->dx[e];
 	}
-	edges[e].step_x = edges[e].inc_x * (edges[e].dx / edges[e].dy);
-	edges[e].dx = edges[e].dx % edges[e].dy;
+	edges->step_x[e] = edges->inc_x[e] * (edges->dx[e] / edges->dy[e]);
+	edges->dx[e] = edges->dx[e] % edges->dy[e];
 
-	edges[e].top = vertices[tv].y + dy;
-	edges[e].bot = vertices[bv].y + dy;
+	edges->top[e] = vertices[tv].y + dy;
+	edges->bot[e] = vertices[bv].y + dy;
 
-	edges[e].x = vertices[tv].x + dx;
-	edges[e].e = 0;
+	edges->x[e] = vertices[tv].x + dx;
+	edges->e[e] = 0;
 
 	/* step to first grid point */
-	_edge_step_by (&edges[e], y - edges[e].top);
+	_edge_step_by (edges, e, y - edges->top[e]);
 
-	edges[e].top = y;
+	edges->top[e] = y;
 	e++;
     }
-    return e;
+    edges->n = e;
 }
     
-static void
+/* 1x1 */
+static const twin_a8_t	_twin_coverage_1[1][1] = {
+    { 0xff },
+};
+
+/* 4x4 */
+static const twin_a8_t	_twin_coverage_4[4][4] = {
+    { 0x10, 0x10, 0x10, 0x10 },
+    { 0x10, 0x10, 0x10, 0x10 },
+    { 0x0f, 0x10, 0x10, 0x10 },
+    { 0x10, 0x10, 0x10, 0x10 },
+};
+
+/* 16x16 */
+#define C16 { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }
+static const twin_a8_t	_twin_coverage_16[16][16] = {
+    C16, C16, C16, C16, C16, C16, C16, C16,
+    { 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+    C16, C16, C16, C16, C16, C16, C16,
+};
+#undef C16
+
+static TWIN_POLY_INLINE const twin_a8_t *
+_twin_coverage (int shift, int row)
+{
+    switch (shift) {
+    case 0:
+	return _twin_coverage_1[row];
+    case 2:
+	return _twin_coverage_4[row];
+    default:
+	return _twin_coverage_16[row];
+    }
+}
+
+static TWIN_POLY_INLINE void
 _span_fill (twin_pixmap_t   *pixmap,
+	    twin_extent_t   *rows,
 	    twin_sfixed_t    y,
 	    twin_sfixed_t    left,
-	    twin_sfixed_t    right)
+	    twin_sfixed_t    right,
+	    int		     shift)
 {
-#if TWIN_POLY_SHIFT == 0
-    /* 1x1 */
-    static const twin_a8_t	coverage[1][1] = {
-	{ 0xff },
-    };
-#endif
-#if TWIN_POLY_SHIFT == 1
-    /* 2x2 */
-    static const twin_a8_t	coverage[2][2] = {
-	{ 0x40, 0x40 },
-	{ 0x3f, 0x40 },
-    };
-#endif
-#if TWIN_POLY_SHIFT == 2
-    /* 4x4 */
-    static const twin_a8_t	coverage[4][4] = {
-	{ 0x10, 0x10, 0x10, 0x10 },
-	{ 0x10, 0x10, 0x10, 0x10 },
-	{ 0x0f, 0x10, 0x10, 0x10 },
-	{ 0x10, 0x10, 0x10, 0x10 },
-    };
-#endif
-#if TWIN_POLY_SHIFT == 3
-    /* 8x8 */
-    static const twin_a8_t	coverage[8][8] = {
-	{ 4, 4, 4, 4, 4, 4, 4, 4 },
-	{ 4, 4, 4, 4, 4, 4, 4, 4 },
-	{ 4, 4, 4, 4, 4, 4, 4, 4 },
-	{ 4, 4, 4, 4, 4, 4, 4, 4 },
-	{ 3, 4, 4, 4, 4, 4, 4, 4 },
-	{ 4, 4, 4, 4, 4, 4, 4, 4 },
-	{ 4, 4, 4, 4, 4, 4, 4, 4 },
-	{ 4, 4, 4, 4, 4, 4, 4, 4 },
-    };
-#endif
-    const twin_a8_t *cover = coverage[(y >> TWIN_POLY_FIXED_SHIFT) & TWIN_POLY_MASK];
+    const twin_a8_t *cover = _twin_coverage (shift,
+					     (y >> TWIN_POLY_FIXED_SHIFT(shift)) &
+					     TWIN_POLY_MASK(shift));
     int		    row = twin_sfixed_trunc (y);
     twin_a8_t	    *span = pixmap->p.a8 + row * pixmap->stride;
     twin_a8_t	    *s;
@@ -210,24 +225,44 @@ _span_fill (twin_pixmap_t   *pixmap,
 	right = twin_int_to_sfixed (pixmap->clip.right);
 
     /* convert to sample grid */
-    left = _twin_sfixed_grid_ceil (left) >> TWIN_POLY_FIXED_SHIFT;
-    right = _twin_sfixed_grid_ceil (right) >> TWIN_POLY_FIXED_SHIFT;
+    left = _twin_sfixed_grid_ceil (left, shift) >> TWIN_POLY_FIXED_SHIFT(shift);
+    right = _twin_sfixed_grid_ceil (right, shift) >> TWIN_POLY_FIXED_SHIFT(shift);
     
     /* check for empty */
     if (right <= left)
 	return;
 
+    if (rows)
+    {
+	twin_extent_t	*e = &rows[row];
+	twin_coord_t	l = left >> shift;
+	twin_coord_t	r = (right + TWIN_POLY_MASK(shift)) >> shift;
+
+	if (e->left >= e->right)
+	{
+	    e->left = l;
+	    e->right = r;
+	}
+	else
+	{
+	    if (l < e->left)
+		e->left = l;
+	    if (r > e->right)
+		e->right = r;
+	}
+    }
+
     x = left;
     
     /* starting address */
-    s = span + (x >> TWIN_POLY_SHIFT);
+    s = span + (x >> shift);
     
     /* first pixel */
-    if (x & TWIN_POLY_MASK)
+    if (x & TWIN_POLY_MASK(shift))
     {
 	w = 0;
 	col = 0;
-	while (x < right && (x & TWIN_POLY_MASK))
+	while (x < right && (x & TWIN_POLY_MASK(shift)))
 	{
 	    w += cover[col++];
 	    x++;
@@ -237,19 +272,19 @@ _span_fill (twin_pixmap_t   *pixmap,
     }
 
     w = 0;
-    for (col = 0; col < TWIN_POLY_SAMPLE; col++)
+    for (col = 0; col < TWIN_POLY_SAMPLE(shift); col++)
 	w += cover[col];
 
     /* middle pixels */
-    while (x + TWIN_POLY_MASK < right)
+    while (x + TWIN_POLY_MASK(shift) < right)
     {
 	a = *s + w;
 	*s++ = twin_sat (a);
-	x += TWIN_POLY_SAMPLE;
+	x += TWIN_POLY_SAMPLE(shift);
     }
     
-    /* last pixel */
-    if (right & TWIN_POLY_MASK)
+    /* last pixel, unless the first one reached right */
+    if (x < right)
     {
 	w = 0;
 	col = 0;
@@ -263,103 +298,217 @@ _span_fill (twin_pixmap_t   *pixmap,
     }
 }
 
-static void
-_twin_edge_fill (twin_pixmap_t *pixmap, twin_edge_t *edges, int nedges)
+/*
+ * Edges are bucketed by their first sample row, and the active edges
+ * kept sorted by x in an array of edge indices
+ */
+static TWIN_POLY_INLINE void
+_twin_edge_fill (twin_pixmap_t *pixmap, twin_extent_t *rows,
+		 twin_row_func_t row_done, void *closure,
+		 twin_edges_t *edges, int *order, int *active, int shift)
 {
-    twin_edge_t	    *active, *a, *n, **prev;
-    int		    e;
-    twin_sfixed_t    y;
-    twin_sfixed_t    x0 = 0;
+    int		    *bucket;
+    int		    nbucket, nactive;
+    int		    b, e, i, j, k;
+    twin_coord_t    row = -1;
+    twin_sfixed_t   y, ymin, ymax;
+    twin_sfixed_t   x, x0 = 0;
     int		    w;
-    
-    qsort (edges, nedges, sizeof (twin_edge_t), _edge_compare_y);
+
+    if (!edges->n)
+	return;
+    ymin = ymax = edges->top[0];
+    for (e = 1; e < edges->n; e++)
+    {
+	if (edges->top[e] < ymin)
+	    ymin = edges->top[e];
+	if (edges->top[e] > ymax)
+	    ymax = edges->top[e];
+    }
+
+    /* edge tops all lie on the sample grid */
+    nbucket = (ymax - ymin) / TWIN_POLY_STEP(shift) + 1;
+    bucket = calloc (nbucket + 1, sizeof (int));
+    if (!bucket)
+	return;
+    for (e = 0; e < edges->n; e++)
+	bucket[(edges->top[e] - ymin) / TWIN_POLY_STEP(shift) + 1]++;
+    for (b = 1; b <= nbucket; b++)
+	bucket[b] += bucket[b - 1];
+    /* leaves bucket[b] at the end of row b's edges in order */
+    for (e = 0; e < edges->n; e++)
+	order[bucket[(edges->top[e] - ymin) / TWIN_POLY_STEP(shift)]++] = e;
+
     e = 0;
-    y = edges[0].top;
-    active = 0;
+    b = 0;
+    y = ymin;
+    nactive = 0;
     for (;;)
     {
 	/* add in new edges */
-	for (;e < nedges && edges[e].top <= y; e++)
+	for (; b < nbucket && e < bucket[b]; e++)
 	{
-	    for (prev = &active; (a = *prev); prev = &(a->next))
-		if (a->x > edges[e].x)
-		    break;
-	    edges[e].next = *prev;
-	    *prev = &edges[e];
+	    k = order[e];
+	    x = edges->x[k];
+	    for (i = nactive++; i > 0 && edges->x[active[i - 1]] > x; i--)
+		active[i] = active[i - 1];
+	    active[i] = k;
+	}
+
+	/* pass on the pixel row just finished */
+	if (twin_sfixed_trunc (y) != row)
+	{
+	    if (row_done && row >= 0)
+		(*row_done) (row, closure);
+	    row = twin_sfixed_trunc (y);
 	}
 	
 	DBGOUT ("Y %9.4f:", F(y));
 	/* walk this y value marking coverage */
 	w = 0;
-	for (a = active; a; a = a->next)
+	for (i = 0; i < nactive; i++)
 	{
-	    DBGOUT (" %9.4f(%d)", F(a->x), a->winding);
+	    k = active[i];
+	    DBGOUT (" %9.4f(%d)", F(edges->x[k]), edges->winding[k]);
 	    if (w == 0)
-		x0 = a->x;
-	    w += a->winding;
+		x0 = edges->x[k];
+	    w += edges->winding[k];
 	    if (w == 0)
 	    {
 		DBGOUT (" F ");
-		_span_fill (pixmap, y, x0, a->x);
+		_span_fill (pixmap, rows, y, x0, edges->x[k], shift);
 	    }
 	}
 	DBGOUT ("\n");
 	
 	/* step down, clipping to pixmap */
-	y += TWIN_POLY_STEP;
+	y += TWIN_POLY_STEP(shift);
+	b++;
 
 	if (twin_sfixed_trunc (y) >= pixmap->clip.bottom)
 	    break;
 	
 	/* strip out dead edges */
-	for (prev = &active; (a = *prev);)
+	for (i = j = 0; i < nactive; i++)
+	    if (edges->bot[active[i]] > y)
+		active[j++] = active[i];
+	nactive = j;
+
+	if (!nactive)
 	{
-	    if (a->bot <= y)
-		*prev = a->next;
-	    else
-		prev = &a->next;
+	    /* check for all done */
+	    if (e == edges->n)
+		break;
+	    /* skip the empty rows down to the next edge */
+	    k = order[e];
+	    b = (edges->top[k] - ymin) / TWIN_POLY_STEP(shift);
+	    y = edges->top[k];
+	    continue;
 	}
-
-	/* check for all done */
-	if (!active && e == nedges)
-	    break;
 	
 	/* step all edges */
-	for (a = active; a; a = a->next)
-	    _edge_step_by (a, TWIN_POLY_STEP);
+	for (i = 0; i < nactive; i++)
+	    _edge_step_by (edges, active[i], TWIN_POLY_STEP(shift));
 	
 	/* fix x sorting */
-	for (prev = &active; (a = *prev) && (n = a->next);)
+	for (i = 1; i < nactive; i++)
 	{
-	    if (a->x > n->x)
-	    {
-		a->next = n->next;
-		n->next = a;
-		*prev = n;
-		prev = &active;
-	    }
-	    else
-		prev = &a->next;
+	    k = active[i];
+	    x = edges->x[k];
+	    for (j = i; j > 0 && edges->x[active[j - 1]] > x; j--)
+		active[j] = active[j - 1];
+	    active[j] = k;
 	}
     }
+    if (row_done && row >= 0)
+	(*row_done) (row, closure);
+    free (bucket);
+}
+
+/*
+ * One copy of the fill for each sample grid, so the inner loops see
+ * a constant shift
+ */
+static void
+_twin_edge_fill_1 (twin_pixmap_t *pixmap, twin_extent_t *rows,
+		   twin_row_func_t row_done, void *closure,
+		   twin_edges_t *edges, int *order, int *active)
+{
+    _twin_edge_fill (pixmap, rows, row_done, closure,
+		     edges, order, active, 0);
 }
 
+static void
+_twin_edge_fill_4 (twin_pixmap_t *pixmap, twin_extent_t *rows,
+		   twin_row_func_t row_done, void *closure,
+		   twin_edges_t *edges, int *order, int *active)
+{
+    _twin_edge_fill (pixmap, rows, row_done, closure,
+		     edges, order, active, 2);
+}
+
+static void
+_twin_edge_fill_16 (twin_pixmap_t *pixmap, twin_extent_t *rows,
+		    twin_row_func_t row_done, void *closure,
+		    twin_edges_t *edges, int *order, int *active)
+{
+    _twin_edge_fill (pixmap, rows, row_done, closure,
+		     edges, order, active, 4);
+}
+
+/*
+ * Fill path into an A8 pixmap, noting the columns touched on each
+ * pixmap row in rows and calling row_done as each row is finished,
+ * when given
+ */
 void
-twin_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
-		twin_coord_t dx, twin_coord_t dy)
+_twin_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
+		 twin_coord_t dx, twin_coord_t dy, twin_extent_t *rows,
+		 twin_row_func_t row_done, void *closure)
 {
-    twin_edge_t	    *edges;
-    int		    nedges, n;
+    twin_edges_t    edges;
+    twin_sfixed_t   *fields;
+    int		    *order;
     int		    nalloc;
     int		    s;
     int		    p;
     twin_sfixed_t   sdx = twin_int_to_sfixed (dx + pixmap->origin_x);
     twin_sfixed_t   sdy = twin_int_to_sfixed (dy + pixmap->origin_y);
+    int		    shift;
 
+    /* overlapping paths take the finest sampling instead */
+    if (pixmap->antialias == TWIN_ANTIALIAS_EXACT &&
+	_twin_area_fill_path (pixmap, path, dx, dy, rows, row_done, closure))
+	return;
+    switch (pixmap->antialias) {
+    case TWIN_ANTIALIAS_NONE:
+	shift = 0;
+	break;
+    case TWIN_ANTIALIAS_BEST:
+    case TWIN_ANTIALIAS_EXACT:
+	shift = 4;
+	break;
+    default:
+	shift = 2;
+	break;
+    }
     nalloc = path->npoints + path->nsublen + 1;
-    edges = malloc (sizeof (twin_edge_t) * nalloc);
+    /* eight edge fields, the winding, the bucket order and active edges */
+    fields = malloc (nalloc * (8 * sizeof (twin_sfixed_t) + 3 * sizeof (int)));
+    if (!fields)
+	return;
+    edges.n = 0;
+    edges.top = fields;
+    edges.bot = fields + nalloc;
+    edges.x = fields + 2 * nalloc;
+    edges.e = fields + 3 * nalloc;
+    edges.dx = fields + 4 * nalloc;
+    edges.dy = fields + 5 * nalloc;
+    edges.inc_x = fields + 6 * nalloc;
+    edges.step_x = fields + 7 * nalloc;
+    edges.winding = (int *) (fields + 8 * nalloc);
+    order = edges.winding + nalloc;
     p = 0;
-    nedges = 0;
     for (s = 0; s <= path->nsublen; s++)
     {
 	int sublen;
@@ -372,14 +521,35 @@ twin_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
 	npoints = sublen - p;
 	if (npoints > 1)
 	{
-	    n = _twin_edge_build (path->points + p, npoints, edges + nedges,
-				  sdx, sdy,
-				  twin_int_to_sfixed (pixmap->clip.top));
+	    _twin_edge_build (path->points + p, npoints, &edges,
+			      sdx, sdy,
+			      twin_int_to_sfixed (pixmap->clip.top),
+			      twin_int_to_sfixed (pixmap->clip.bottom),
+			      shift);
 	    p = sublen;
-	    nedges += n;
 	}
     }
-    _twin_edge_fill (pixmap, edges, nedges);
-    free (edges);
+    switch (shift) {
+    case 0:
+	_twin_edge_fill_1 (pixmap, rows, row_done, closure,
+			   &edges, order, order + nalloc);
+	break;
+    case 2:
+	_twin_edge_fill_4 (pixmap, rows, row_done, closure,
+			   &edges, order, order + nalloc);
+	break;
+    default:
+	_twin_edge_fill_16 (pixmap, rows, row_done, closure,
+			    &edges, order, order + nalloc);
+	break;
+    }
+    free (fields);
+}
+
+void
+twin_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
+		twin_coord_t dx, twin_coord_t dy)
+{
+    _twin_fill_path (pixmap, path, dx, dy, NULL, NULL, NULL);
 }
 
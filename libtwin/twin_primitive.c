@@ -21,6 +21,14 @@
 
 #include "twinint.h"
 
+/* these rely on __inline, so come before it goes away */
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+
 #define __inline
 
 static twin_argb32_t __inline
@@ -164,6 +172,109 @@ argb32_to_a8 (twin_argb32_t v)
 
 #define _twin_op_name(src,op,dst) cat4(_twin_,src,op,dst)
 
+/*
+ * Lengths of the runs of pixels starting a span which over can
+ * copy (opaque), skip (clear) or must blend (mixed).  A8 runs are
+ * checked a word at a time
+ */
+static int
+_twin_argb32_run (const twin_argb32_t *p, int width,
+		  twin_argb32_t mask, twin_argb32_t value)
+{
+    int	n = 0;
+
+    while (n < width && (p[n] & mask) == value)
+	n++;
+    return n;
+}
+
+static int
+_twin_argb32_mixed_run (const twin_argb32_t *p, int width,
+			twin_argb32_t clear_mask)
+{
+    int	n = 0;
+
+    while (n < width && (p[n] & clear_mask) && p[n] < 0xff000000)
+	n++;
+    return n;
+}
+
+static int
+_twin_a8_run (const twin_a8_t *p, int width, twin_a8_t value)
+{
+    uint32_t	word = value * 0x01010101U;
+    uint32_t	w;
+    int		n = 0;
+
+    for (; n + 4 <= width; n += 4)
+    {
+	memcpy (&w, p + n, sizeof (w));
+	if (w != word)
+	    break;
+    }
+    while (n < width && p[n] == value)
+	n++;
+    return n;
+}
+
+static int
+_twin_a8_mixed_run (const twin_a8_t *p, int width)
+{
+    int	n = 0;
+
+    while (n < width && p[n] && p[n] != 0xff)
+	n++;
+    return n;
+}
+
+#define run_src_argb32_opaque	_twin_argb32_run (src.p.argb32, width, \
+						  0xff000000, 0xff000000)
+#define run_src_argb32_clear	_twin_argb32_run (src.p.argb32, width, \
+						  0xffffffff, 0)
+#define run_src_argb32_mixed	_twin_argb32_mixed_run (src.p.argb32, width, \
+							0xffffffff)
+#define run_src_rgb16_opaque	(width)
+#define run_src_rgb16_clear	0
+#define run_src_rgb16_mixed	0
+#define run_src_a8_opaque	_twin_a8_run (src.p.a8, width, 0xff)
+#define run_src_a8_clear	_twin_a8_run (src.p.a8, width, 0)
+#define run_src_a8_mixed	_twin_a8_mixed_run (src.p.a8, width)
+#define run_src_c_opaque	(src.c >= 0xff000000 ? width : 0)
+#define run_src_c_clear		(src.c == 0 ? width : 0)
+#define run_src_c_mixed		(width)
+
+#define run_msk_argb32_opaque	_twin_argb32_run (msk.p.argb32, width, \
+						  0xff000000, 0xff000000)
+#define run_msk_argb32_clear	_twin_argb32_run (msk.p.argb32, width, \
+						  0xff000000, 0)
+#define run_msk_argb32_mixed	_twin_argb32_mixed_run (msk.p.argb32, width, \
+							0xff000000)
+#define run_msk_rgb16_opaque	(width)
+#define run_msk_rgb16_clear	0
+#define run_msk_rgb16_mixed	0
+#define run_msk_a8_opaque	_twin_a8_run (msk.p.a8, width, 0xff)
+#define run_msk_a8_clear	_twin_a8_run (msk.p.a8, width, 0)
+#define run_msk_a8_mixed	_twin_a8_mixed_run (msk.p.a8, width)
+#define run_msk_c_opaque	(argb32_to_a8 (msk.c) == 0xff ? width : 0)
+#define run_msk_c_clear		(argb32_to_a8 (msk.c) == 0 ? width : 0)
+#define run_msk_c_mixed		(width)
+
+#define skip_dst_argb32(n)	(dst.argb32 += (n))
+#define skip_dst_rgb16(n)	(dst.rgb16 += (n))
+#define skip_dst_a8(n)		(dst.a8 += (n))
+#define skip_src_argb32(n)	(src.p.argb32 += (n))
+#define skip_src_rgb16(n)	(src.p.rgb16 += (n))
+#define skip_src_a8(n)		(src.p.a8 += (n))
+#define skip_src_c(n)		((void) 0)
+#define skip_msk_argb32(n)	(msk.p.argb32 += (n))
+#define skip_msk_rgb16(n)	(msk.p.rgb16 += (n))
+#define skip_msk_a8(n)		(msk.p.a8 += (n))
+#define skip_msk_c(n)		((void) 0)
+
+/*
+ * Where the mask is clear nothing changes, where it is opaque this
+ * is a plain over; only the pixels between are masked one by one
+ */
 #define make_twin_in_over(__dst,__src,__msk) \
 void \
 _twin_in_op_name(__src,_over_,__msk,__dst)(twin_pointer_t   dst, \
@@ -174,12 +285,28 @@ _twin_in_op_name(__src,_over_,__msk,__dst)(twin_pointer_t   dst, \
     twin_argb32_t   dst32; \
     twin_argb32_t   src32; \
     twin_a8_t	    msk8; \
-    while (width--) { \
-	dst32 = cat3(dst_,__dst,_get); \
-	src32 = cat2(src_,__src); \
-	msk8 = cat2(msk_,__msk); \
-	dst32 = in_over (dst32, src32, msk8); \
-	cat3(dst_,__dst,_set) (dst32); \
+    int		    run, i; \
+    while (width > 0) { \
+	if ((run = cat3(run_msk_,__msk,_clear))) \
+	    ; \
+	else if ((run = cat3(run_msk_,__msk,_opaque))) \
+	    _twin_op_name(__src,_over_,__dst) (dst, src, run); \
+	else { \
+	    run = cat3(run_msk_,__msk,_mixed); \
+	    for (i = 0; i < run; i++) { \
+		dst32 = cat3(dst_,__dst,_get); \
+		src32 = cat2(src_,__src); \
+		msk8 = cat2(msk_,__msk); \
+		dst32 = in_over (dst32, src32, msk8); \
+		cat3(dst_,__dst,_set) (dst32); \
+	    } \
+	    width -= run; \
+	    continue; \
+	} \
+	cat2(skip_dst_,__dst) (run); \
+	cat2(skip_src_,__src) (run); \
+	cat2(skip_msk_,__msk) (run); \
+	width -= run; \
     } \
 }
 
@@ -221,6 +348,9 @@ make_twin_in_op_srcs_msks(op,a8)
 make_twin_in_op_dsts_srcs_msks(over)
 make_twin_in_op_dsts_srcs_msks(source)
 
+/*
+ * Opaque runs are copied and clear ones skipped
+ */
 #define make_twin_over(__dst,__src) \
 void \
 _twin_op_name(__src,_over_,__dst) (twin_pointer_t   dst, \
@@ -229,11 +359,24 @@ _twin_op_name(__src,_over_,__dst) (twin_pointer_t   dst, \
 { \
     twin_argb32_t   dst32; \
     twin_argb32_t   src32; \
-    while (width--) { \
-	dst32 = cat3(dst_,__dst,_get); \
-	src32 = cat2(src_,__src); \
-	dst32 = over (dst32, src32); \
-	cat3(dst_,__dst,_set) (dst32); \
+    int		    run, i; \
+    while (width > 0) { \
+	if ((run = cat3(run_src_,__src,_opaque))) \
+	    _twin_op_name(__src,_source_,__dst) (dst, src, run); \
+	else if (!(run = cat3(run_src_,__src,_clear))) { \
+	    run = cat3(run_src_,__src,_mixed); \
+	    for (i = 0; i < run; i++) { \
+		dst32 = cat3(dst_,__dst,_get); \
+		src32 = cat2(src_,__src); \
+		dst32 = over (dst32, src32); \
+		cat3(dst_,__dst,_set) (dst32); \
+	    } \
+	    width -= run; \
+	    continue; \
+	} \
+	cat2(skip_dst_,__dst) (run); \
+	cat2(skip_src_,__src) (run); \
+	width -= run; \
     } \
 }
 
@@ -266,6 +409,233 @@ make_twin_op_srcs(op,a8)
 make_twin_op_dsts_srcs(over);
 make_twin_op_dsts_srcs(source)
 
+#ifdef HAVE_VECTOR
+
+/*
+ * The same operators written with the compiler's generic vector
+ * extensions, four pixels at a time, so that any target the compiler
+ * knows gets SIMD code.  Each pixel is widened to four 16-bit
+ * channels, where twin_int_mult and twin_sat fit without overflow,
+ * so results match the scalar code exactly.  Leftover pixels go to
+ * the scalar versions above.
+ */
+typedef uint8_t	    twin_v4u8_t	    __attribute__((vector_size(4)));
+typedef uint16_t    twin_v4u16_t    __attribute__((vector_size(8)));
+typedef uint32_t    twin_v4u32_t    __attribute__((vector_size(16)));
+typedef uint8_t	    twin_v16u8_t    __attribute__((vector_size(16)));
+typedef uint16_t    twin_v16u16_t   __attribute__((vector_size(32)));
+
+static inline twin_v4u32_t
+vext_splat (twin_argb32_t v)
+{
+    twin_v4u32_t    r = { v, v, v, v };
+
+    return r;
+}
+
+static inline twin_bool_t
+vext_zero (twin_v4u32_t v)
+{
+    return !(v[0] | v[1] | v[2] | v[3]);
+}
+
+/* true when every lane has all of the bits in m set */
+static inline twin_bool_t
+vext_all (twin_v4u32_t v, twin_argb32_t m)
+{
+    return (v[0] & v[1] & v[2] & v[3] & m) == m;
+}
+
+/*
+ * These are macros as the 16-bit channel vectors are wider than the
+ * target may pass in registers
+ */
+#define vext_widen(v)	__builtin_convertvector ((twin_v16u8_t) (v), \
+						 twin_v16u16_t)
+#define vext_narrow(v)	((twin_v4u32_t) __builtin_convertvector ((v), \
+								 twin_v16u8_t))
+
+/* copy each lane's low byte into all four of its bytes */
+#define vext_spread(v)	vext_widen ((v) | ((v) << 8) | \
+				    ((v) << 16) | ((v) << 24))
+
+#define vext_int_mult(a,b,t)	((t) = (a) * (b) + 0x80, \
+				 (((t) >> 8) + (t)) >> 8)
+
+static inline twin_v4u32_t
+vext_in (twin_v4u32_t src, twin_v4u32_t msk)
+{
+    twin_v16u16_t   t;
+
+    return vext_narrow (vext_int_mult (vext_widen (src), vext_spread (msk), t));
+}
+
+static inline twin_v4u32_t
+vext_over (twin_v4u32_t dst, twin_v4u32_t src)
+{
+    twin_v4u32_t    a = src >> 24;
+    twin_v16u16_t   t;
+
+    t = vext_int_mult (vext_widen (dst), 0xff - vext_spread (a), t) +
+	vext_widen (src);
+    /* twin_sat; narrowing drops the high byte */
+    return vext_narrow (t | (0 - (t >> 8)));
+}
+
+static inline twin_v4u32_t
+vext_load_argb32 (const twin_argb32_t *p)
+{
+    twin_v4u32_t    v;
+
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+static inline twin_v4u32_t
+vext_load_rgb16 (const twin_rgb16_t *p)
+{
+    twin_v4u16_t    h;
+    twin_v4u32_t    v;
+
+    memcpy (&h, p, sizeof (h));
+    v = __builtin_convertvector (h, twin_v4u32_t);
+    return twin_rgb16_to_argb32 (v);
+}
+
+static inline twin_v4u32_t
+vext_load_a8 (const twin_a8_t *p)
+{
+    twin_v4u8_t	    b;
+
+    memcpy (&b, p, sizeof (b));
+    return __builtin_convertvector (b, twin_v4u32_t);
+}
+
+static inline void
+vext_store_argb32 (twin_argb32_t *p, twin_v4u32_t v)
+{
+    memcpy (p, &v, sizeof (v));
+}
+
+static inline void
+vext_store_rgb16 (twin_rgb16_t *p, twin_v4u32_t v)
+{
+    twin_v4u16_t    h = __builtin_convertvector (twin_argb32_to_rgb16 (v),
+						 twin_v4u16_t);
+
+    memcpy (p, &h, sizeof (h));
+}
+
+static inline void
+vext_store_a8 (twin_a8_t *p, twin_v4u32_t v)
+{
+    twin_v4u8_t	    b = __builtin_convertvector (v >> 24, twin_v4u8_t);
+
+    memcpy (p, &b, sizeof (b));
+}
+
+#define vext_dst_argb32_get	(vext_load_argb32 (dst.argb32))
+#define vext_dst_argb32_set(v)	(vext_store_argb32 (dst.argb32, v), \
+				 dst.argb32 += 4)
+#define vext_dst_rgb16_get	(vext_load_rgb16 (dst.rgb16))
+#define vext_dst_rgb16_set(v)	(vext_store_rgb16 (dst.rgb16, v), \
+				 dst.rgb16 += 4)
+#define vext_dst_a8_get		(vext_load_a8 (dst.a8) << 24)
+#define vext_dst_a8_set(v)	(vext_store_a8 (dst.a8, v), dst.a8 += 4)
+
+#define vext_src_c		(vext_splat (src.c))
+#define vext_src_argb32		(src.p.argb32 += 4, \
+				 vext_load_argb32 (src.p.argb32 - 4))
+#define vext_src_rgb16		(src.p.rgb16 += 4, \
+				 vext_load_rgb16 (src.p.rgb16 - 4))
+#define vext_src_a8		(src.p.a8 += 4, \
+				 vext_load_a8 (src.p.a8 - 4) << 24)
+
+#define vext_msk_c		(vext_splat (argb32_to_a8 (msk.c)))
+#define vext_msk_argb32		(msk.p.argb32 += 4, \
+				 vext_load_argb32 (msk.p.argb32 - 4) >> 24)
+#define vext_msk_rgb16		(vext_splat (0xff))
+#define vext_msk_a8		(msk.p.a8 += 4, vext_load_a8 (msk.p.a8 - 4))
+
+#define _twin_vext_in_op_name(src,op,msk,dst) \
+    cat6(_twin_vext_,src,_in_,msk,op,dst)
+
+#define _twin_vext_op_name(src,op,dst) cat4(_twin_vext_,src,op,dst)
+
+#define make_twin_vext_in_over(__dst,__src,__msk) \
+void \
+_twin_vext_in_op_name(__src,_over_,__msk,__dst)(twin_pointer_t   dst, \
+						twin_source_u    src, \
+						twin_source_u    msk, \
+						int		 width) \
+{ \
+    twin_v4u32_t    dst4; \
+    twin_v4u32_t    src4; \
+    twin_v4u32_t    msk4; \
+    for (; width >= 4; width -= 4) { \
+	dst4 = cat3(vext_dst_,__dst,_get); \
+	src4 = cat2(vext_src_,__src); \
+	msk4 = cat2(vext_msk_,__msk); \
+	if (!vext_zero (msk4)) { \
+	    if (!vext_all (msk4, 0xff)) \
+		src4 = vext_in (src4, msk4); \
+	    dst4 = (vext_all (src4, 0xff000000) ? src4 : \
+		    vext_over (dst4, src4)); \
+	} \
+	cat3(vext_dst_,__dst,_set) (dst4); \
+    } \
+    _twin_in_op_name(__src,_over_,__msk,__dst) (dst, src, msk, width); \
+}
+
+#define make_twin_vext_in_over_msks(dst,src) \
+make_twin_vext_in_over(dst,src,argb32) \
+make_twin_vext_in_over(dst,src,rgb16) \
+make_twin_vext_in_over(dst,src,a8) \
+make_twin_vext_in_over(dst,src,c)
+
+#define make_twin_vext_in_over_srcs_msks(dst) \
+make_twin_vext_in_over_msks(dst,argb32) \
+make_twin_vext_in_over_msks(dst,rgb16) \
+make_twin_vext_in_over_msks(dst,a8) \
+make_twin_vext_in_over_msks(dst,c)
+
+make_twin_vext_in_over_srcs_msks(argb32)
+make_twin_vext_in_over_srcs_msks(rgb16)
+make_twin_vext_in_over_srcs_msks(a8)
+
+#define make_twin_vext_over(__dst,__src) \
+void \
+_twin_vext_op_name(__src,_over_,__dst) (twin_pointer_t   dst, \
+					twin_source_u    src, \
+					int		 width) \
+{ \
+    twin_v4u32_t    dst4; \
+    twin_v4u32_t    src4; \
+    for (; width >= 4; width -= 4) { \
+	dst4 = cat3(vext_dst_,__dst,_get); \
+	src4 = cat2(vext_src_,__src); \
+	/* opaque blocks are copied and clear ones left alone */ \
+	if (vext_all (src4, 0xff000000)) \
+	    dst4 = src4; \
+	else if (!vext_zero (src4)) \
+	    dst4 = vext_over (dst4, src4); \
+	cat3(vext_dst_,__dst,_set) (dst4); \
+    } \
+    _twin_op_name(__src,_over_,__dst) (dst, src, width); \
+}
+
+#define make_twin_vext_over_srcs(dst) \
+make_twin_vext_over(dst,argb32) \
+make_twin_vext_over(dst,rgb16) \
+make_twin_vext_over(dst,a8) \
+make_twin_vext_over(dst,c)
+
+make_twin_vext_over_srcs(argb32)
+make_twin_vext_over_srcs(rgb16)
+make_twin_vext_over_srcs(a8)
+
+#endif /* HAVE_VECTOR */
+
 #ifdef HAVE_ALTIVEC
 
 #include <altivec.h>
@@ -400,3 +770,1306 @@ void _twin_vec_argb32_source_argb32 (twin_pointer_t	dst,
 }
 
 #endif /* HAVE_ALTIVEC */
+
+#ifdef HAVE_SSE2
+
+#define TWIN_SSE2   __attribute__((target("sse2")))
+
+/*
+ * Four pixels of over (), rounding exactly as the scalar code does
+ */
+static inline __m128i TWIN_SSE2
+over_sse2 (__m128i dst, __m128i src)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    const __m128i   x80 = _mm_set1_epi16 (0x80);
+    const __m128i   xff = _mm_set1_epi16 (0xff);
+    __m128i	    lo, hi, a;
+
+    lo = _mm_unpacklo_epi8 (src, zero);
+    a = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (lo, 0xff), 0xff);
+    lo = _mm_mullo_epi16 (_mm_unpacklo_epi8 (dst, zero),
+			  _mm_xor_si128 (a, xff));
+    lo = _mm_add_epi16 (lo, x80);
+    lo = _mm_srli_epi16 (_mm_add_epi16 (lo, _mm_srli_epi16 (lo, 8)), 8);
+
+    hi = _mm_unpackhi_epi8 (src, zero);
+    a = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (hi, 0xff), 0xff);
+    hi = _mm_mullo_epi16 (_mm_unpackhi_epi8 (dst, zero),
+			  _mm_xor_si128 (a, xff));
+    hi = _mm_add_epi16 (hi, x80);
+    hi = _mm_srli_epi16 (_mm_add_epi16 (hi, _mm_srli_epi16 (hi, 8)), 8);
+
+    return _mm_adds_epu8 (_mm_packus_epi16 (lo, hi), src);
+}
+
+/*
+ * Widen four rgb16 pixels, held in 32 bit lanes, as rgb16_to_argb32 ()
+ */
+static inline __m128i TWIN_SSE2
+rgb16_to_argb32_sse2 (__m128i s)
+{
+    __m128i	    b, g, r;
+
+    b = _mm_or_si128 (_mm_and_si128 (_mm_slli_epi32 (s, 3),
+				     _mm_set1_epi32 (0xf8)),
+		      _mm_and_si128 (_mm_srli_epi32 (s, 2),
+				     _mm_set1_epi32 (0x7)));
+    g = _mm_or_si128 (_mm_and_si128 (_mm_slli_epi32 (s, 5),
+				     _mm_set1_epi32 (0xfc00)),
+		      _mm_and_si128 (_mm_srli_epi32 (s, 1),
+				     _mm_set1_epi32 (0x300)));
+    r = _mm_or_si128 (_mm_and_si128 (_mm_slli_epi32 (s, 8),
+				     _mm_set1_epi32 (0xf80000)),
+		      _mm_and_si128 (_mm_slli_epi32 (s, 3),
+				     _mm_set1_epi32 (0x70000)));
+    return _mm_or_si128 (_mm_or_si128 (b, g),
+			 _mm_or_si128 (r, _mm_set1_epi32 (0xff000000)));
+}
+
+/*
+ * Narrow four argb32 pixels to rgb16, left in 32 bit lanes
+ */
+static inline __m128i TWIN_SSE2
+argb32_to_rgb16_sse2 (__m128i s)
+{
+    return _mm_or_si128 (_mm_or_si128 (_mm_and_si128 (_mm_srli_epi32 (s, 3),
+						      _mm_set1_epi32 (0x001f)),
+				       _mm_and_si128 (_mm_srli_epi32 (s, 5),
+						      _mm_set1_epi32 (0x07e0))),
+			 _mm_and_si128 (_mm_srli_epi32 (s, 8),
+					_mm_set1_epi32 (0xf800)));
+}
+
+/*
+ * Pack eight rgb16 values from 32 bit lanes; SSE2 only has a signed
+ * saturating pack, so bias the values into range and back
+ */
+static inline __m128i TWIN_SSE2
+pack_rgb16_sse2 (__m128i lo, __m128i hi)
+{
+    const __m128i   bias32 = _mm_set1_epi32 (0x8000);
+    const __m128i   bias16 = _mm_set1_epi16 ((short) 0x8000);
+
+    return _mm_xor_si128 (_mm_packs_epi32 (_mm_sub_epi32 (lo, bias32),
+					   _mm_sub_epi32 (hi, bias32)),
+			  bias16);
+}
+
+void TWIN_SSE2
+_twin_sse2_argb32_over_argb32 (twin_pointer_t	dst,
+			       twin_source_u	src,
+			       int		width)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    const __m128i   alpha = _mm_set1_epi32 (0xff000000);
+    twin_argb32_t   dst32;
+    twin_argb32_t   src32;
+    __m128i	    s;
+
+    while (width >= 4)
+    {
+	s = _mm_loadu_si128 ((__m128i *) src.p.argb32);
+	/* skip clear pixels, copy opaque ones */
+	if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (s, zero)) != 0xffff)
+	{
+	    if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (_mm_and_si128 (s, alpha),
+						    alpha)) != 0xffff)
+		s = over_sse2 (_mm_loadu_si128 ((__m128i *) dst.argb32), s);
+	    _mm_storeu_si128 ((__m128i *) dst.argb32, s);
+	}
+	src.p.argb32 += 4;
+	dst.argb32 += 4;
+	width -= 4;
+    }
+    while (width--) {
+	dst32 = dst_argb32_get;
+	src32 = src_argb32;
+	dst32 = over (dst32, src32);
+	dst_argb32_set (dst32);
+    }
+}
+
+void TWIN_SSE2
+_twin_sse2_argb32_source_argb32 (twin_pointer_t	dst,
+				 twin_source_u	src,
+				 int		width)
+{
+    while (width >= 4)
+    {
+	_mm_storeu_si128 ((__m128i *) dst.argb32,
+			  _mm_loadu_si128 ((__m128i *) src.p.argb32));
+	src.p.argb32 += 4;
+	dst.argb32 += 4;
+	width -= 4;
+    }
+    while (width--)
+	dst_argb32_set (src_argb32);
+}
+
+void TWIN_SSE2
+_twin_sse2_rgb16_source_argb32 (twin_pointer_t	dst,
+				twin_source_u	src,
+				int		width)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    __m128i	    s;
+
+    while (width >= 8)
+    {
+	s = _mm_loadu_si128 ((__m128i *) src.p.rgb16);
+	_mm_storeu_si128 ((__m128i *) dst.argb32,
+			  rgb16_to_argb32_sse2 (_mm_unpacklo_epi16 (s, zero)));
+	_mm_storeu_si128 ((__m128i *) dst.argb32 + 1,
+			  rgb16_to_argb32_sse2 (_mm_unpackhi_epi16 (s, zero)));
+	src.p.rgb16 += 8;
+	dst.argb32 += 8;
+	width -= 8;
+    }
+    while (width--)
+	dst_argb32_set (src_rgb16);
+}
+
+void TWIN_SSE2
+_twin_sse2_argb32_over_rgb16 (twin_pointer_t	dst,
+			      twin_source_u	src,
+			      int		width)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    twin_argb32_t   dst32;
+    twin_argb32_t   src32;
+    __m128i	    s0, s1, d;
+
+    while (width >= 8)
+    {
+	s0 = _mm_loadu_si128 ((__m128i *) src.p.argb32);
+	s1 = _mm_loadu_si128 ((__m128i *) src.p.argb32 + 1);
+	if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (_mm_or_si128 (s0, s1),
+						zero)) != 0xffff)
+	{
+	    d = _mm_loadu_si128 ((__m128i *) dst.rgb16);
+	    s0 = over_sse2 (rgb16_to_argb32_sse2 (_mm_unpacklo_epi16 (d, zero)),
+			    s0);
+	    s1 = over_sse2 (rgb16_to_argb32_sse2 (_mm_unpackhi_epi16 (d, zero)),
+			    s1);
+	    _mm_storeu_si128 ((__m128i *) dst.rgb16,
+			      pack_rgb16_sse2 (argb32_to_rgb16_sse2 (s0),
+					       argb32_to_rgb16_sse2 (s1)));
+	}
+	src.p.argb32 += 8;
+	dst.rgb16 += 8;
+	width -= 8;
+    }
+    while (width--) {
+	dst32 = dst_rgb16_get;
+	src32 = src_argb32;
+	dst32 = over (dst32, src32);
+	dst_rgb16_set (dst32);
+    }
+}
+
+void TWIN_SSE2
+_twin_sse2_argb32_source_rgb16 (twin_pointer_t	dst,
+				twin_source_u	src,
+				int		width)
+{
+    __m128i	    s0, s1;
+
+    while (width >= 8)
+    {
+	s0 = _mm_loadu_si128 ((__m128i *) src.p.argb32);
+	s1 = _mm_loadu_si128 ((__m128i *) src.p.argb32 + 1);
+	_mm_storeu_si128 ((__m128i *) dst.rgb16,
+			  pack_rgb16_sse2 (argb32_to_rgb16_sse2 (s0),
+					   argb32_to_rgb16_sse2 (s1)));
+	src.p.argb32 += 8;
+	dst.rgb16 += 8;
+	width -= 8;
+    }
+    while (width--)
+	dst_rgb16_set (src_argb32);
+}
+
+/*
+ * rgb16 is opaque, so over is source, and widening to argb32
+ * and narrowing back loses nothing
+ */
+void TWIN_SSE2
+_twin_sse2_rgb16_source_rgb16 (twin_pointer_t	dst,
+			       twin_source_u	src,
+			       int		width)
+{
+    while (width >= 8)
+    {
+	_mm_storeu_si128 ((__m128i *) dst.rgb16,
+			  _mm_loadu_si128 ((__m128i *) src.p.rgb16));
+	src.p.rgb16 += 8;
+	dst.rgb16 += 8;
+	width -= 8;
+    }
+    while (width--)
+	*dst.rgb16++ = *src.p.rgb16++;
+}
+
+/*
+ * Solid colour c, unpacked to 16 bit lanes, in the coverage held in
+ * the low four bytes of m, giving four pixels; in () in parallel
+ */
+static inline __m128i TWIN_SSE2
+in_sse2 (__m128i c16, __m128i m)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    const __m128i   x80 = _mm_set1_epi16 (0x80);
+    __m128i	    lo, hi;
+
+    m = _mm_unpacklo_epi8 (m, zero);
+    m = _mm_unpacklo_epi16 (m, m);
+    lo = _mm_add_epi16 (_mm_mullo_epi16 (c16, _mm_unpacklo_epi32 (m, m)), x80);
+    lo = _mm_srli_epi16 (_mm_add_epi16 (lo, _mm_srli_epi16 (lo, 8)), 8);
+    hi = _mm_add_epi16 (_mm_mullo_epi16 (c16, _mm_unpackhi_epi32 (m, m)), x80);
+    hi = _mm_srli_epi16 (_mm_add_epi16 (hi, _mm_srli_epi16 (hi, 8)), 8);
+    return _mm_packus_epi16 (lo, hi);
+}
+
+static inline __m128i TWIN_SSE2
+load_a8x4_sse2 (twin_a8_t *p)
+{
+    int	    v;
+
+    memcpy (&v, p, sizeof (v));
+    return _mm_cvtsi32_si128 (v);
+}
+
+/*
+ * Masks from path rasterization are mostly empty or solid; runs of
+ * sixteen like pixels are either skipped or filled without any
+ * per pixel multiplies
+ */
+void TWIN_SSE2
+_twin_sse2_c_in_a8_over_argb32 (twin_pointer_t	dst,
+				twin_source_u	src,
+				twin_source_u	msk,
+				int		width)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    const __m128i   ones = _mm_set1_epi8 ((char) 0xff);
+    const __m128i   c = _mm_set1_epi32 (src.c);
+    const __m128i   c16 = _mm_unpacklo_epi8 (c, zero);
+    twin_bool_t	    opaque = (src.c >> 24) == 0xff;
+    twin_argb32_t   dst32;
+    twin_a8_t	    msk8;
+    __m128i	    m, *d;
+    int		    i, full;
+
+    while (width >= 16)
+    {
+	m = _mm_loadu_si128 ((__m128i *) msk.p.a8);
+	if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (m, zero)) != 0xffff)
+	{
+	    full = _mm_movemask_epi8 (_mm_cmpeq_epi8 (m, ones)) == 0xffff;
+	    for (i = 0; i < 4; i++)
+	    {
+		d = (__m128i *) dst.argb32 + i;
+		if (full && opaque)
+		    _mm_storeu_si128 (d, c);
+		else
+		    _mm_storeu_si128 (d, over_sse2 (_mm_loadu_si128 (d),
+						    full ? c : in_sse2 (c16, m)));
+		m = _mm_srli_si128 (m, 4);
+	    }
+	}
+	dst.argb32 += 16;
+	msk.p.a8 += 16;
+	width -= 16;
+    }
+    while (width >= 4)
+    {
+	m = load_a8x4_sse2 (msk.p.a8);
+	if (_mm_cvtsi128_si32 (m))
+	{
+	    d = (__m128i *) dst.argb32;
+	    _mm_storeu_si128 (d, over_sse2 (_mm_loadu_si128 (d),
+					    in_sse2 (c16, m)));
+	}
+	dst.argb32 += 4;
+	msk.p.a8 += 4;
+	width -= 4;
+    }
+    while (width--) {
+	dst32 = dst_argb32_get;
+	msk8 = msk_a8;
+	dst32 = in_over (dst32, src_c, msk8);
+	dst_argb32_set (dst32);
+    }
+}
+
+void TWIN_SSE2
+_twin_sse2_c_in_a8_over_rgb16 (twin_pointer_t	dst,
+			       twin_source_u	src,
+			       twin_source_u	msk,
+			       int		width)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    const __m128i   ones = _mm_set1_epi8 ((char) 0xff);
+    const __m128i   c = _mm_set1_epi32 (src.c);
+    const __m128i   c16 = _mm_unpacklo_epi8 (c, zero);
+    const __m128i   c_rgb16 = _mm_set1_epi16 ((short) argb32_to_rgb16 (src.c));
+    twin_bool_t	    opaque = (src.c >> 24) == 0xff;
+    twin_argb32_t   dst32;
+    twin_a8_t	    msk8;
+    __m128i	    m, s0, s1, v, *d;
+    int		    i, full;
+
+    while (width >= 16)
+    {
+	m = _mm_loadu_si128 ((__m128i *) msk.p.a8);
+	if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (m, zero)) != 0xffff)
+	{
+	    full = _mm_movemask_epi8 (_mm_cmpeq_epi8 (m, ones)) == 0xffff;
+	    for (i = 0; i < 2; i++)
+	    {
+		d = (__m128i *) dst.rgb16 + i;
+		if (full && opaque)
+		    _mm_storeu_si128 (d, c_rgb16);
+		else
+		{
+		    s0 = full ? c : in_sse2 (c16, m);
+		    s1 = full ? c : in_sse2 (c16, _mm_srli_si128 (m, 4));
+		    v = _mm_loadu_si128 (d);
+		    s0 = over_sse2 (rgb16_to_argb32_sse2 (
+					_mm_unpacklo_epi16 (v, zero)), s0);
+		    s1 = over_sse2 (rgb16_to_argb32_sse2 (
+					_mm_unpackhi_epi16 (v, zero)), s1);
+		    _mm_storeu_si128 (d, pack_rgb16_sse2 (
+					     argb32_to_rgb16_sse2 (s0),
+					     argb32_to_rgb16_sse2 (s1)));
+		}
+		m = _mm_srli_si128 (m, 8);
+	    }
+	}
+	dst.rgb16 += 16;
+	msk.p.a8 += 16;
+	width -= 16;
+    }
+    while (width >= 8)
+    {
+	m = _mm_loadl_epi64 ((__m128i *) msk.p.a8);
+	if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (m, zero)) != 0xffff)
+	{
+	    d = (__m128i *) dst.rgb16;
+	    v = _mm_loadu_si128 (d);
+	    s0 = over_sse2 (rgb16_to_argb32_sse2 (_mm_unpacklo_epi16 (v, zero)),
+			    in_sse2 (c16, m));
+	    s1 = over_sse2 (rgb16_to_argb32_sse2 (_mm_unpackhi_epi16 (v, zero)),
+			    in_sse2 (c16, _mm_srli_si128 (m, 4)));
+	    _mm_storeu_si128 (d, pack_rgb16_sse2 (argb32_to_rgb16_sse2 (s0),
+						  argb32_to_rgb16_sse2 (s1)));
+	}
+	dst.rgb16 += 8;
+	msk.p.a8 += 8;
+	width -= 8;
+    }
+    while (width--) {
+	dst32 = dst_rgb16_get;
+	msk8 = msk_a8;
+	dst32 = in_over (dst32, src_c, msk8);
+	dst_rgb16_set (dst32);
+    }
+}
+
+void TWIN_SSE2
+_twin_sse2_c_in_a8_over_a8 (twin_pointer_t	dst,
+			    twin_source_u	src,
+			    twin_source_u	msk,
+			    int			width)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    const __m128i   ones = _mm_set1_epi8 ((char) 0xff);
+    const __m128i   x80 = _mm_set1_epi16 (0x80);
+    const __m128i   xff = _mm_set1_epi16 (0xff);
+    const __m128i   ca = _mm_set1_epi16 (src.c >> 24);
+    twin_argb32_t   dst32;
+    twin_a8_t	    msk8;
+    __m128i	    m, v, s[2], t[2];
+    int		    i;
+
+    while (width >= 16)
+    {
+	m = _mm_loadu_si128 ((__m128i *) msk.p.a8);
+	if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (m, zero)) != 0xffff)
+	{
+	    if ((src.c >> 24) == 0xff &&
+		_mm_movemask_epi8 (_mm_cmpeq_epi8 (m, ones)) == 0xffff)
+		_mm_storeu_si128 ((__m128i *) dst.a8, ones);
+	    else
+	    {
+		v = _mm_loadu_si128 ((__m128i *) dst.a8);
+		s[0] = _mm_unpacklo_epi8 (m, zero);
+		s[1] = _mm_unpackhi_epi8 (m, zero);
+		t[0] = _mm_unpacklo_epi8 (v, zero);
+		t[1] = _mm_unpackhi_epi8 (v, zero);
+		for (i = 0; i < 2; i++)
+		{
+		    /* coverage times source alpha, then dst times its inverse */
+		    s[i] = _mm_add_epi16 (_mm_mullo_epi16 (s[i], ca), x80);
+		    s[i] = _mm_srli_epi16 (_mm_add_epi16 (s[i],
+							  _mm_srli_epi16 (s[i], 8)),
+					   8);
+		    t[i] = _mm_add_epi16 (_mm_mullo_epi16 (t[i],
+							   _mm_xor_si128 (s[i],
+									  xff)),
+					  x80);
+		    t[i] = _mm_srli_epi16 (_mm_add_epi16 (t[i],
+							  _mm_srli_epi16 (t[i], 8)),
+					   8);
+		}
+		_mm_storeu_si128 ((__m128i *) dst.a8,
+				  _mm_adds_epu8 (_mm_packus_epi16 (t[0], t[1]),
+						 _mm_packus_epi16 (s[0], s[1])));
+	    }
+	}
+	dst.a8 += 16;
+	msk.p.a8 += 16;
+	width -= 16;
+    }
+    while (width--) {
+	dst32 = dst_a8_get;
+	msk8 = msk_a8;
+	dst32 = in_over (dst32, src_c, msk8);
+	dst_a8_set (dst32);
+    }
+}
+
+void TWIN_SSE2
+_twin_sse2_c_source_argb32 (twin_pointer_t	dst,
+			    twin_source_u	src,
+			    int			width)
+{
+    const __m128i   c = _mm_set1_epi32 (src.c);
+
+    while (width >= 4)
+    {
+	_mm_storeu_si128 ((__m128i *) dst.argb32, c);
+	dst.argb32 += 4;
+	width -= 4;
+    }
+    while (width--)
+	dst_argb32_set (src_c);
+}
+
+void TWIN_SSE2
+_twin_sse2_c_over_argb32 (twin_pointer_t	dst,
+			  twin_source_u		src,
+			  int			width)
+{
+    const __m128i   c = _mm_set1_epi32 (src.c);
+    twin_argb32_t   dst32;
+    __m128i	    *d;
+
+    if ((src.c >> 24) == 0xff)
+    {
+	_twin_sse2_c_source_argb32 (dst, src, width);
+	return;
+    }
+    if (!src.c)
+	return;
+    while (width >= 4)
+    {
+	d = (__m128i *) dst.argb32;
+	_mm_storeu_si128 (d, over_sse2 (_mm_loadu_si128 (d), c));
+	dst.argb32 += 4;
+	width -= 4;
+    }
+    while (width--) {
+	dst32 = dst_argb32_get;
+	dst32 = over (dst32, src_c);
+	dst_argb32_set (dst32);
+    }
+}
+
+void TWIN_SSE2
+_twin_sse2_c_source_rgb16 (twin_pointer_t	dst,
+			   twin_source_u	src,
+			   int			width)
+{
+    const __m128i   c = _mm_set1_epi16 ((short) argb32_to_rgb16 (src.c));
+
+    while (width >= 8)
+    {
+	_mm_storeu_si128 ((__m128i *) dst.rgb16, c);
+	dst.rgb16 += 8;
+	width -= 8;
+    }
+    while (width--)
+	dst_rgb16_set (src_c);
+}
+
+void TWIN_SSE2
+_twin_sse2_c_over_rgb16 (twin_pointer_t	dst,
+			 twin_source_u	src,
+			 int		width)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    const __m128i   c = _mm_set1_epi32 (src.c);
+    twin_argb32_t   dst32;
+    __m128i	    v, *d;
+
+    if ((src.c >> 24) == 0xff)
+    {
+	_twin_sse2_c_source_rgb16 (dst, src, width);
+	return;
+    }
+    if (!src.c)
+	return;
+    while (width >= 8)
+    {
+	d = (__m128i *) dst.rgb16;
+	v = _mm_loadu_si128 (d);
+	_mm_storeu_si128 (d, pack_rgb16_sse2 (
+			      argb32_to_rgb16_sse2 (over_sse2 (
+				  rgb16_to_argb32_sse2 (
+				      _mm_unpacklo_epi16 (v, zero)), c)),
+			      argb32_to_rgb16_sse2 (over_sse2 (
+				  rgb16_to_argb32_sse2 (
+				      _mm_unpackhi_epi16 (v, zero)), c))));
+	dst.rgb16 += 8;
+	width -= 8;
+    }
+    while (width--) {
+	dst32 = dst_rgb16_get;
+	dst32 = over (dst32, src_c);
+	dst_rgb16_set (dst32);
+    }
+}
+
+/*
+ * a + ((b - a) * w >> 16) in 16 bit lanes, which is how the scalar
+ * lerp rounds.  mulhi is signed, so a weight past 0x7fff comes back
+ * short by (b - a); add that back in.
+ */
+static inline __m128i TWIN_SSE2
+lerp_sse2 (__m128i a, __m128i b, __m128i w)
+{
+    __m128i	    d = _mm_sub_epi16 (b, a);
+
+    return _mm_add_epi16 (a, _mm_add_epi16 (_mm_mulhi_epi16 (d, w),
+					    _mm_and_si128 (d,
+							   _mm_srai_epi16 (w, 15))));
+}
+
+/*
+ * Two bilinear samples from their taps, top and bot holding
+ * [ l0 r0 l1 r1 ] in argb32 and wx, wy each pixel's weight four
+ * times over.  The samples come back in 16 bit lanes.
+ */
+static inline __m128i TWIN_SSE2
+bilinear2_sse2 (__m128i top, __m128i bot, __m128i wx, __m128i wy)
+{
+    const __m128i   zero = _mm_setzero_si128 ();
+    __m128i	    lo, hi, t, b;
+
+    lo = _mm_unpacklo_epi8 (top, zero);
+    hi = _mm_unpackhi_epi8 (top, zero);
+    t = lerp_sse2 (_mm_unpacklo_epi64 (lo, hi), _mm_unpackhi_epi64 (lo, hi),
+		   wx);
+    lo = _mm_unpacklo_epi8 (bot, zero);
+    hi = _mm_unpackhi_epi8 (bot, zero);
+    b = lerp_sse2 (_mm_unpacklo_epi64 (lo, hi), _mm_unpackhi_epi64 (lo, hi),
+		   wx);
+    return lerp_sse2 (t, b, wy);
+}
+
+/*
+ * The two taps starting at p, as argb32 in the low half
+ */
+static inline __m128i TWIN_SSE2
+taps_sse2 (const uint8_t *p, twin_format_t format)
+{
+    int		    v;
+
+    if (format == TWIN_ARGB32)
+	return _mm_loadl_epi64 ((const __m128i *) p);
+    memcpy (&v, p, sizeof (v));
+    return rgb16_to_argb32_sse2 (_mm_unpacklo_epi16 (_mm_cvtsi32_si128 (v),
+						     _mm_setzero_si128 ()));
+}
+
+/*
+ * Four samples at a time while all of their taps are inside the
+ * clip; anything near the edges goes to the C code
+ */
+static inline void TWIN_SSE2
+bilinear_sse2 (twin_argb32_t	*dst,
+	       twin_pixmap_t	*pix,
+	       twin_fixed_t	sx,
+	       twin_fixed_t	sy,
+	       twin_fixed_t	ux,
+	       twin_fixed_t	uy,
+	       twin_coord_t	width,
+	       twin_format_t	format,
+	       twin_bilinear_func *fallback)
+{
+    const uint8_t   *row[4];
+    unsigned int    wx[4], wy[4];
+    twin_coord_t    x, y;
+    twin_pointer_t  d;
+    int		    i, bpp = twin_bytes_per_pixel (format);
+    __m128i	    top, bot, lo, hi;
+
+    while (width >= 4)
+    {
+	for (i = 0; i < 4; i++)
+	{
+	    x = twin_fixed_to_int (sx + i * ux);
+	    y = twin_fixed_to_int (sy + i * uy);
+	    if (x < pix->clip.left || x + 1 >= pix->clip.right ||
+		y < pix->clip.top || y + 1 >= pix->clip.bottom)
+		break;
+	    row[i] = pix->p.b + y * pix->stride + x * bpp;
+	    wx[i] = (sx + i * ux) & 0xffff;
+	    wy[i] = (sy + i * uy) & 0xffff;
+	}
+	if (i < 4)
+	{
+	    d.argb32 = dst;
+	    (*fallback) (d, pix, sx, sy, ux, uy, 4);
+	}
+	else
+	{
+	    top = _mm_unpacklo_epi64 (taps_sse2 (row[0], format),
+				      taps_sse2 (row[1], format));
+	    bot = _mm_unpacklo_epi64 (taps_sse2 (row[0] + pix->stride, format),
+				      taps_sse2 (row[1] + pix->stride, format));
+	    lo = bilinear2_sse2 (top, bot,
+				 _mm_set_epi16 (wx[1], wx[1], wx[1], wx[1],
+						wx[0], wx[0], wx[0], wx[0]),
+				 _mm_set_epi16 (wy[1], wy[1], wy[1], wy[1],
+						wy[0], wy[0], wy[0], wy[0]));
+	    top = _mm_unpacklo_epi64 (taps_sse2 (row[2], format),
+				      taps_sse2 (row[3], format));
+	    bot = _mm_unpacklo_epi64 (taps_sse2 (row[2] + pix->stride, format),
+				      taps_sse2 (row[3] + pix->stride, format));
+	    hi = bilinear2_sse2 (top, bot,
+				 _mm_set_epi16 (wx[3], wx[3], wx[3], wx[3],
+						wx[2], wx[2], wx[2], wx[2]),
+				 _mm_set_epi16 (wy[3], wy[3], wy[3], wy[3],
+						wy[2], wy[2], wy[2], wy[2]));
+	    _mm_storeu_si128 ((__m128i *) dst, _mm_packus_epi16 (lo, hi));
+	}
+	sx += 4 * ux;
+	sy += 4 * uy;
+	dst += 4;
+	width -= 4;
+    }
+    d.argb32 = dst;
+    (*fallback) (d, pix, sx, sy, ux, uy, width);
+}
+
+void TWIN_SSE2
+_twin_sse2_argb32_bilinear (twin_pointer_t	dst,
+			    twin_pixmap_t	*pix,
+			    twin_fixed_t	sx,
+			    twin_fixed_t	sy,
+			    twin_fixed_t	ux,
+			    twin_fixed_t	uy,
+			    twin_coord_t	width)
+{
+    bilinear_sse2 (dst.argb32, pix, sx, sy, ux, uy, width,
+		   TWIN_ARGB32, _twin_argb32_bilinear);
+}
+
+void TWIN_SSE2
+_twin_sse2_rgb16_bilinear (twin_pointer_t	dst,
+			   twin_pixmap_t	*pix,
+			   twin_fixed_t		sx,
+			   twin_fixed_t		sy,
+			   twin_fixed_t		ux,
+			   twin_fixed_t		uy,
+			   twin_coord_t		width)
+{
+    bilinear_sse2 (dst.argb32, pix, sx, sy, ux, uy, width,
+		   TWIN_RGB16, _twin_rgb16_bilinear);
+}
+
+#endif /* HAVE_SSE2 */
+
+#ifdef HAVE_AVX2
+
+#define TWIN_AVX2   __attribute__((target("avx2")))
+
+/*
+ * The scalar tails below clear the upper halves of the vector
+ * registers first; the compiler does not always do so on that path,
+ * and SSE code run after a kernel left dirty stalls badly
+ */
+
+/*
+ * Eight pixels of over (); unpacking and packing both stay within
+ * 128 bit lanes, so the pixels come back out in order
+ */
+static inline __m256i TWIN_AVX2
+over_avx2 (__m256i dst, __m256i src)
+{
+    const __m256i   zero = _mm256_setzero_si256 ();
+    const __m256i   x80 = _mm256_set1_epi16 (0x80);
+    const __m256i   xff = _mm256_set1_epi16 (0xff);
+    __m256i	    lo, hi, a;
+
+    lo = _mm256_unpacklo_epi8 (src, zero);
+    a = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (lo, 0xff), 0xff);
+    lo = _mm256_mullo_epi16 (_mm256_unpacklo_epi8 (dst, zero),
+			     _mm256_xor_si256 (a, xff));
+    lo = _mm256_add_epi16 (lo, x80);
+    lo = _mm256_srli_epi16 (_mm256_add_epi16 (lo, _mm256_srli_epi16 (lo, 8)),
+			    8);
+
+    hi = _mm256_unpackhi_epi8 (src, zero);
+    a = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (hi, 0xff), 0xff);
+    hi = _mm256_mullo_epi16 (_mm256_unpackhi_epi8 (dst, zero),
+			     _mm256_xor_si256 (a, xff));
+    hi = _mm256_add_epi16 (hi, x80);
+    hi = _mm256_srli_epi16 (_mm256_add_epi16 (hi, _mm256_srli_epi16 (hi, 8)),
+			    8);
+
+    return _mm256_adds_epu8 (_mm256_packus_epi16 (lo, hi), src);
+}
+
+/*
+ * Widen eight rgb16 pixels, held in 32 bit lanes, to argb32
+ */
+static inline __m256i TWIN_AVX2
+rgb16_to_argb32_avx2 (__m256i s)
+{
+    __m256i	    b, g, r;
+
+    b = _mm256_or_si256 (_mm256_and_si256 (_mm256_slli_epi32 (s, 3),
+					   _mm256_set1_epi32 (0xf8)),
+			 _mm256_and_si256 (_mm256_srli_epi32 (s, 2),
+					   _mm256_set1_epi32 (0x7)));
+    g = _mm256_or_si256 (_mm256_and_si256 (_mm256_slli_epi32 (s, 5),
+					   _mm256_set1_epi32 (0xfc00)),
+			 _mm256_and_si256 (_mm256_srli_epi32 (s, 1),
+					   _mm256_set1_epi32 (0x300)));
+    r = _mm256_or_si256 (_mm256_and_si256 (_mm256_slli_epi32 (s, 8),
+					   _mm256_set1_epi32 (0xf80000)),
+			 _mm256_and_si256 (_mm256_slli_epi32 (s, 3),
+					   _mm256_set1_epi32 (0x70000)));
+    return _mm256_or_si256 (_mm256_or_si256 (b, g),
+			    _mm256_or_si256 (r,
+					     _mm256_set1_epi32 (0xff000000)));
+}
+
+/*
+ * Load eight rgb16 pixels widened to argb32
+ */
+static inline __m256i TWIN_AVX2
+load_rgb16_avx2 (twin_rgb16_t *p)
+{
+    return rgb16_to_argb32_avx2 (
+	_mm256_cvtepu16_epi32 (_mm_loadu_si128 ((__m128i *) p)));
+}
+
+/*
+ * Narrow eight argb32 pixels to rgb16 and store them
+ */
+static inline void TWIN_AVX2
+store_rgb16_avx2 (twin_rgb16_t *p, __m256i s)
+{
+    s = _mm256_or_si256 (_mm256_or_si256 (
+			     _mm256_and_si256 (_mm256_srli_epi32 (s, 3),
+					       _mm256_set1_epi32 (0x001f)),
+			     _mm256_and_si256 (_mm256_srli_epi32 (s, 5),
+					       _mm256_set1_epi32 (0x07e0))),
+			 _mm256_and_si256 (_mm256_srli_epi32 (s, 8),
+					   _mm256_set1_epi32 (0xf800)));
+    _mm_storeu_si128 ((__m128i *) p,
+		      _mm_packus_epi32 (_mm256_castsi256_si128 (s),
+					_mm256_extracti128_si256 (s, 1)));
+}
+
+void TWIN_AVX2
+_twin_avx2_argb32_over_argb32 (twin_pointer_t	dst,
+			       twin_source_u	src,
+			       int		width)
+{
+    const __m256i   alpha = _mm256_set1_epi32 (0xff000000);
+    twin_argb32_t   dst32;
+    twin_argb32_t   src32;
+    __m256i	    s;
+
+    while (width >= 8)
+    {
+	s = _mm256_loadu_si256 ((__m256i *) src.p.argb32);
+	/* skip clear pixels, copy opaque ones */
+	if (!_mm256_testz_si256 (s, s))
+	{
+	    if ((unsigned) _mm256_movemask_epi8 (
+		    _mm256_cmpeq_epi32 (_mm256_and_si256 (s, alpha),
+					alpha)) != 0xffffffff)
+		s = over_avx2 (_mm256_loadu_si256 ((__m256i *) dst.argb32), s);
+	    _mm256_storeu_si256 ((__m256i *) dst.argb32, s);
+	}
+	src.p.argb32 += 8;
+	dst.argb32 += 8;
+	width -= 8;
+    }
+    _mm256_zeroupper ();
+    while (width--) {
+	dst32 = dst_argb32_get;
+	src32 = src_argb32;
+	dst32 = over (dst32, src32);
+	dst_argb32_set (dst32);
+    }
+}
+
+void TWIN_AVX2
+_twin_avx2_rgb16_source_argb32 (twin_pointer_t	dst,
+				twin_source_u	src,
+				int		width)
+{
+    while (width >= 8)
+    {
+	_mm256_storeu_si256 ((__m256i *) dst.argb32,
+			     load_rgb16_avx2 (src.p.rgb16));
+	src.p.rgb16 += 8;
+	dst.argb32 += 8;
+	width -= 8;
+    }
+    _mm256_zeroupper ();
+    while (width--)
+	dst_argb32_set (src_rgb16);
+}
+
+void TWIN_AVX2
+_twin_avx2_argb32_over_rgb16 (twin_pointer_t	dst,
+			      twin_source_u	src,
+			      int		width)
+{
+    twin_argb32_t   dst32;
+    twin_argb32_t   src32;
+    __m256i	    s;
+
+    while (width >= 8)
+    {
+	s = _mm256_loadu_si256 ((__m256i *) src.p.argb32);
+	if (!_mm256_testz_si256 (s, s))
+	    store_rgb16_avx2 (dst.rgb16,
+			      over_avx2 (load_rgb16_avx2 (dst.rgb16), s));
+	src.p.argb32 += 8;
+	dst.rgb16 += 8;
+	width -= 8;
+    }
+    _mm256_zeroupper ();
+    while (width--) {
+	dst32 = dst_rgb16_get;
+	src32 = src_argb32;
+	dst32 = over (dst32, src32);
+	dst_rgb16_set (dst32);
+    }
+}
+
+/*
+ * Solid colour c, unpacked to 16 bit lanes, in the coverage of the
+ * eight pixels starting at p
+ */
+static inline __m256i TWIN_AVX2
+in_avx2 (__m256i c16, twin_a8_t *p)
+{
+    const __m256i   zero = _mm256_setzero_si256 ();
+    const __m256i   x80 = _mm256_set1_epi16 (0x80);
+    const __m256i   rep = _mm256_setr_epi8 (0, 0, 0, 0, 1, 1, 1, 1,
+					    2, 2, 2, 2, 3, 3, 3, 3,
+					    4, 4, 4, 4, 5, 5, 5, 5,
+					    6, 6, 6, 6, 7, 7, 7, 7);
+    __m256i	    m, lo, hi;
+
+    /* each coverage byte repeated for the four channels of its pixel */
+    m = _mm256_shuffle_epi8 (
+	_mm256_broadcastq_epi64 (_mm_loadl_epi64 ((__m128i *) p)), rep);
+    lo = _mm256_add_epi16 (_mm256_mullo_epi16 (c16,
+					       _mm256_unpacklo_epi8 (m, zero)),
+			   x80);
+    lo = _mm256_srli_epi16 (_mm256_add_epi16 (lo, _mm256_srli_epi16 (lo, 8)),
+			    8);
+    hi = _mm256_add_epi16 (_mm256_mullo_epi16 (c16,
+					       _mm256_unpackhi_epi8 (m, zero)),
+			   x80);
+    hi = _mm256_srli_epi16 (_mm256_add_epi16 (hi, _mm256_srli_epi16 (hi, 8)),
+			    8);
+    return _mm256_packus_epi16 (lo, hi);
+}
+
+/*
+ * As the SSE2 versions, but skipping or filling 32 pixels at a time
+ */
+void TWIN_AVX2
+_twin_avx2_c_in_a8_over_argb32 (twin_pointer_t	dst,
+				twin_source_u	src,
+				twin_source_u	msk,
+				int		width)
+{
+    const __m256i   zero = _mm256_setzero_si256 ();
+    const __m256i   ones = _mm256_set1_epi8 ((char) 0xff);
+    const __m256i   c = _mm256_set1_epi32 (src.c);
+    const __m256i   c16 = _mm256_unpacklo_epi8 (c, zero);
+    twin_bool_t	    opaque = (src.c >> 24) == 0xff;
+    twin_argb32_t   dst32;
+    twin_a8_t	    msk8;
+    __m256i	    m, *d;
+    int		    i, full;
+
+    while (width >= 32)
+    {
+	m = _mm256_loadu_si256 ((__m256i *) msk.p.a8);
+	if (!_mm256_testz_si256 (m, m))
+	{
+	    full = ((unsigned) _mm256_movemask_epi8 (
+			_mm256_cmpeq_epi8 (m, ones)) == 0xffffffff);
+	    for (i = 0; i < 4; i++)
+	    {
+		d = (__m256i *) dst.argb32 + i;
+		if (full && opaque)
+		    _mm256_storeu_si256 (d, c);
+		else
+		    _mm256_storeu_si256 (d, over_avx2 (
+					     _mm256_loadu_si256 (d),
+					     full ? c : in_avx2 (c16,
+								 msk.p.a8 +
+								 i * 8)));
+	    }
+	}
+	dst.argb32 += 32;
+	msk.p.a8 += 32;
+	width -= 32;
+    }
+    while (width >= 8)
+    {
+	if (_mm_cvtsi128_si64 (_mm_loadl_epi64 ((__m128i *) msk.p.a8)))
+	{
+	    d = (__m256i *) dst.argb32;
+	    _mm256_storeu_si256 (d, over_avx2 (_mm256_loadu_si256 (d),
+					       in_avx2 (c16, msk.p.a8)));
+	}
+	dst.argb32 += 8;
+	msk.p.a8 += 8;
+	width -= 8;
+    }
+#ifdef HAVE_SSE2
+    /* short spans are common, so take four more at a time when possible */
+    while (width >= 4)
+    {
+	__m128i	m4 = load_a8x4_sse2 (msk.p.a8);
+
+	if (_mm_cvtsi128_si32 (m4))
+	{
+	    __m128i *d4 = (__m128i *) dst.argb32;
+
+	    _mm_storeu_si128 (d4, over_sse2 (_mm_loadu_si128 (d4),
+					     in_sse2 (_mm256_castsi256_si128 (c16),
+						      m4)));
+	}
+	dst.argb32 += 4;
+	msk.p.a8 += 4;
+	width -= 4;
+    }
+#endif
+    _mm256_zeroupper ();
+    while (width--) {
+	dst32 = dst_argb32_get;
+	msk8 = msk_a8;
+	dst32 = in_over (dst32, src_c, msk8);
+	dst_argb32_set (dst32);
+    }
+}
+
+void TWIN_AVX2
+_twin_avx2_c_in_a8_over_rgb16 (twin_pointer_t	dst,
+			       twin_source_u	src,
+			       twin_source_u	msk,
+			       int		width)
+{
+    const __m256i   zero = _mm256_setzero_si256 ();
+    const __m256i   ones = _mm256_set1_epi8 ((char) 0xff);
+    const __m256i   c = _mm256_set1_epi32 (src.c);
+    const __m256i   c16 = _mm256_unpacklo_epi8 (c, zero);
+    const __m128i   c_rgb16 = _mm_set1_epi16 ((short) argb32_to_rgb16 (src.c));
+    twin_bool_t	    opaque = (src.c >> 24) == 0xff;
+    twin_argb32_t   dst32;
+    twin_a8_t	    msk8;
+    __m256i	    m;
+    twin_rgb16_t    *d;
+    int		    i, full;
+
+    while (width >= 32)
+    {
+	m = _mm256_loadu_si256 ((__m256i *) msk.p.a8);
+	if (!_mm256_testz_si256 (m, m))
+	{
+	    full = ((unsigned) _mm256_movemask_epi8 (
+			_mm256_cmpeq_epi8 (m, ones)) == 0xffffffff);
+	    for (i = 0; i < 4; i++)
+	    {
+		d = dst.rgb16 + i * 8;
+		if (full && opaque)
+		    _mm_storeu_si128 ((__m128i *) d, c_rgb16);
+		else
+		    store_rgb16_avx2 (d, over_avx2 (load_rgb16_avx2 (d),
+						    full ? c :
+						    in_avx2 (c16,
+							     msk.p.a8 + i * 8)));
+	    }
+	}
+	dst.rgb16 += 32;
+	msk.p.a8 += 32;
+	width -= 32;
+    }
+    while (width >= 8)
+    {
+	if (_mm_cvtsi128_si64 (_mm_loadl_epi64 ((__m128i *) msk.p.a8)))
+	    store_rgb16_avx2 (dst.rgb16,
+			      over_avx2 (load_rgb16_avx2 (dst.rgb16),
+					 in_avx2 (c16, msk.p.a8)));
+	dst.rgb16 += 8;
+	msk.p.a8 += 8;
+	width -= 8;
+    }
+    _mm256_zeroupper ();
+    while (width--) {
+	dst32 = dst_rgb16_get;
+	msk8 = msk_a8;
+	dst32 = in_over (dst32, src_c, msk8);
+	dst_rgb16_set (dst32);
+    }
+}
+
+void TWIN_AVX2
+_twin_avx2_c_in_a8_over_a8 (twin_pointer_t	dst,
+			    twin_source_u	src,
+			    twin_source_u	msk,
+			    int			width)
+{
+    const __m256i   zero = _mm256_setzero_si256 ();
+    const __m256i   ones = _mm256_set1_epi8 ((char) 0xff);
+    const __m256i   x80 = _mm256_set1_epi16 (0x80);
+    const __m256i   xff = _mm256_set1_epi16 (0xff);
+    const __m256i   ca = _mm256_set1_epi16 (src.c >> 24);
+    twin_argb32_t   dst32;
+    twin_a8_t	    msk8;
+    __m256i	    m, v, s[2], t[2];
+    int		    i;
+
+    while (width >= 32)
+    {
+	m = _mm256_loadu_si256 ((__m256i *) msk.p.a8);
+	if (!_mm256_testz_si256 (m, m))
+	{
+	    if ((src.c >> 24) == 0xff &&
+		(unsigned) _mm256_movemask_epi8 (
+		    _mm256_cmpeq_epi8 (m, ones)) == 0xffffffff)
+		_mm256_storeu_si256 ((__m256i *) dst.a8, ones);
+	    else
+	    {
+		v = _mm256_loadu_si256 ((__m256i *) dst.a8);
+		s[0] = _mm256_unpacklo_epi8 (m, zero);
+		s[1] = _mm256_unpackhi_epi8 (m, zero);
+		t[0] = _mm256_unpacklo_epi8 (v, zero);
+		t[1] = _mm256_unpackhi_epi8 (v, zero);
+		for (i = 0; i < 2; i++)
+		{
+		    s[i] = _mm256_add_epi16 (_mm256_mullo_epi16 (s[i], ca),
+					     x80);
+		    s[i] = _mm256_srli_epi16 (
+			_mm256_add_epi16 (s[i], _mm256_srli_epi16 (s[i], 8)),
+			8);
+		    t[i] = _mm256_add_epi16 (
+			_mm256_mullo_epi16 (t[i], _mm256_xor_si256 (s[i], xff)),
+			x80);
+		    t[i] = _mm256_srli_epi16 (
+			_mm256_add_epi16 (t[i], _mm256_srli_epi16 (t[i], 8)),
+			8);
+		}
+		_mm256_storeu_si256 ((__m256i *) dst.a8,
+				     _mm256_adds_epu8 (
+					 _mm256_packus_epi16 (t[0], t[1]),
+					 _mm256_packus_epi16 (s[0], s[1])));
+	    }
+	}
+	dst.a8 += 32;
+	msk.p.a8 += 32;
+	width -= 32;
+    }
+    _mm256_zeroupper ();
+    while (width--) {
+	dst32 = dst_a8_get;
+	msk8 = msk_a8;
+	dst32 = in_over (dst32, src_c, msk8);
+	dst_a8_set (dst32);
+    }
+}
+
+/*
+ * As lerp_sse2 (), sixteen lanes at a time
+ */
+static inline __m256i TWIN_AVX2
+lerp_avx2 (__m256i a, __m256i b, __m256i w)
+{
+    __m256i	    d = _mm256_sub_epi16 (b, a);
+
+    return _mm256_add_epi16 (a, _mm256_add_epi16 (
+				 _mm256_mulhi_epi16 (d, w),
+				 _mm256_and_si256 (d,
+						   _mm256_srai_epi16 (w, 15))));
+}
+
+/*
+ * As bilinear2_sse2 (), on two pairs of pixels, one in each
+ * 128 bit lane
+ */
+static inline __m256i TWIN_AVX2
+bilinear4_avx2 (__m256i top, __m256i bot, __m256i wx, __m256i wy)
+{
+    const __m256i   zero = _mm256_setzero_si256 ();
+    __m256i	    lo, hi, t, b;
+
+    lo = _mm256_unpacklo_epi8 (top, zero);
+    hi = _mm256_unpackhi_epi8 (top, zero);
+    t = lerp_avx2 (_mm256_unpacklo_epi64 (lo, hi),
+		   _mm256_unpackhi_epi64 (lo, hi), wx);
+    lo = _mm256_unpacklo_epi8 (bot, zero);
+    hi = _mm256_unpackhi_epi8 (bot, zero);
+    b = lerp_avx2 (_mm256_unpacklo_epi64 (lo, hi),
+		   _mm256_unpackhi_epi64 (lo, hi), wx);
+    return lerp_avx2 (t, b, wy);
+}
+
+/*
+ * Eight samples at a time, gathering the taps.  Pixels 0, 1, 4 and
+ * 5 are worked on together, then 2, 3, 6 and 7, so that the final
+ * pack puts them back in order.
+ */
+static inline void TWIN_AVX2
+bilinear_avx2 (twin_argb32_t	*dst,
+	       twin_pixmap_t	*pix,
+	       twin_fixed_t	sx,
+	       twin_fixed_t	sy,
+	       twin_fixed_t	ux,
+	       twin_fixed_t	uy,
+	       twin_coord_t	width,
+	       twin_format_t	format,
+	       twin_bilinear_func *fallback)
+{
+    const __m256i   step = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i   low = _mm256_set1_epi32 (0xffff);
+    const __m256i   left = _mm256_set1_epi32 (pix->clip.left - 1);
+    const __m256i   right = _mm256_set1_epi32 (pix->clip.right - 1);
+    const __m256i   top = _mm256_set1_epi32 (pix->clip.top - 1);
+    const __m256i   bottom = _mm256_set1_epi32 (pix->clip.bottom - 1);
+    const __m256i   stride = _mm256_set1_epi32 (pix->stride);
+    const __m256i   even = _mm256_setr_epi32 (0, 1, 4, 5, 0, 1, 4, 5);
+    const __m256i   odd = _mm256_setr_epi32 (2, 3, 6, 7, 2, 3, 6, 7);
+    const uint8_t   *base = pix->p.b;
+    __m256i	    vsx, vsy, x, y, wx, wy, off, t0, t1, b0, b1, r0, r1;
+    twin_pointer_t  d;
+
+    vsx = _mm256_add_epi32 (_mm256_set1_epi32 (sx),
+			    _mm256_mullo_epi32 (step, _mm256_set1_epi32 (ux)));
+    vsy = _mm256_add_epi32 (_mm256_set1_epi32 (sy),
+			    _mm256_mullo_epi32 (step, _mm256_set1_epi32 (uy)));
+    while (width >= 8)
+    {
+	x = _mm256_srai_epi32 (vsx, 16);
+	y = _mm256_srai_epi32 (vsy, 16);
+	if (_mm256_movemask_epi8 (
+		_mm256_and_si256 (
+		    _mm256_and_si256 (_mm256_cmpgt_epi32 (x, left),
+				      _mm256_cmpgt_epi32 (right, x)),
+		    _mm256_and_si256 (_mm256_cmpgt_epi32 (y, top),
+				      _mm256_cmpgt_epi32 (bottom, y)))) != -1)
+	{
+	    d.argb32 = dst;
+	    (*fallback) (d, pix, sx, sy, ux, uy, 8);
+	}
+	else
+	{
+	    wx = _mm256_and_si256 (vsx, low);
+	    wx = _mm256_or_si256 (wx, _mm256_slli_epi32 (wx, 16));
+	    wy = _mm256_and_si256 (vsy, low);
+	    wy = _mm256_or_si256 (wy, _mm256_slli_epi32 (wy, 16));
+	    off = _mm256_mullo_epi32 (y, stride);
+	    if (format == TWIN_ARGB32)
+	    {
+		off = _mm256_add_epi32 (off, _mm256_slli_epi32 (x, 2));
+		t0 = _mm256_i32gather_epi64 ((const long long *) base,
+		    _mm256_castsi256_si128 (
+			_mm256_permutevar8x32_epi32 (off, even)), 1);
+		t1 = _mm256_i32gather_epi64 ((const long long *) base,
+		    _mm256_castsi256_si128 (
+			_mm256_permutevar8x32_epi32 (off, odd)), 1);
+		b0 = _mm256_i32gather_epi64 ((const long long *)
+					     (base + pix->stride),
+		    _mm256_castsi256_si128 (
+			_mm256_permutevar8x32_epi32 (off, even)), 1);
+		b1 = _mm256_i32gather_epi64 ((const long long *)
+					     (base + pix->stride),
+		    _mm256_castsi256_si128 (
+			_mm256_permutevar8x32_epi32 (off, odd)), 1);
+	    }
+	    else
+	    {
+		off = _mm256_add_epi32 (off, _mm256_slli_epi32 (x, 1));
+		r0 = _mm256_i32gather_epi32 ((const int *) base, off, 1);
+		r1 = _mm256_i32gather_epi32 ((const int *) (base + pix->stride),
+					     off, 1);
+		t0 = rgb16_to_argb32_avx2 (
+		    _mm256_unpacklo_epi16 (r0, _mm256_setzero_si256 ()));
+		t1 = rgb16_to_argb32_avx2 (
+		    _mm256_unpackhi_epi16 (r0, _mm256_setzero_si256 ()));
+		b0 = rgb16_to_argb32_avx2 (
+		    _mm256_unpacklo_epi16 (r1, _mm256_setzero_si256 ()));
+		b1 = rgb16_to_argb32_avx2 (
+		    _mm256_unpackhi_epi16 (r1, _mm256_setzero_si256 ()));
+	    }
+	    r0 = bilinear4_avx2 (t0, b0, _mm256_unpacklo_epi32 (wx, wx),
+				 _mm256_unpacklo_epi32 (wy, wy));
+	    r1 = bilinear4_avx2 (t1, b1, _mm256_unpackhi_epi32 (wx, wx),
+				 _mm256_unpackhi_epi32 (wy, wy));
+	    _mm256_storeu_si256 ((__m256i *) dst, _mm256_packus_epi16 (r0, r1));
+	}
+	vsx = _mm256_add_epi32 (vsx, _mm256_set1_epi32 (8 * ux));
+	vsy = _mm256_add_epi32 (vsy, _mm256_set1_epi32 (8 * uy));
+	sx += 8 * ux;
+	sy += 8 * uy;
+	dst += 8;
+	width -= 8;
+    }
+    d.argb32 = dst;
+    (*fallback) (d, pix, sx, sy, ux, uy, width);
+}
+
+void TWIN_AVX2
+_twin_avx2_argb32_bilinear (twin_pointer_t	dst,
+			    twin_pixmap_t	*pix,
+			    twin_fixed_t	sx,
+			    twin_fixed_t	sy,
+			    twin_fixed_t	ux,
+			    twin_fixed_t	uy,
+			    twin_coord_t	width)
+{
+    bilinear_avx2 (dst.argb32, pix, sx, sy, ux, uy, width,
+		   TWIN_ARGB32, _twin_argb32_bilinear);
+}
+
+void TWIN_AVX2
+_twin_avx2_rgb16_bilinear (twin_pointer_t	dst,
+			   twin_pixmap_t	*pix,
+			   twin_fixed_t		sx,
+			   twin_fixed_t		sy,
+			   twin_fixed_t		ux,
+			   twin_fixed_t		uy,
+			   twin_coord_t		width)
+{
+    bilinear_avx2 (dst.argb32, pix, sx, sy, ux, uy, width,
+		   TWIN_RGB16, _twin_rgb16_bilinear);
+}
+
+#endif /* HAVE_AVX2 */
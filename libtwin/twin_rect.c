@@ -0,0 +1,336 @@
+/*
+ * Twin - A Tiny Window System
+ * Copyright © 2004 Keith Packard <keithp@keithp.com>
+ * All rights reserved.
+ *
+ * This Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with the Twin Library; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "twinint.h"
+
+/*
+ * Paths of only horizontal and vertical edges, rectangles and unions
+ * of them.  The path is cut into bands between the y values where
+ * edges start and end; the columns covered don't change within a
+ * band, so its whole pixel rows go out together, fully covered runs
+ * as direct fills and the partial columns through one shared row of
+ * coverage.  Only rows a band boundary crosses sum coverage pixel by
+ * pixel.  Coverage is exact on the 1/16 pixel grid of the path, and
+ * winding is non-zero, as with the other rasterizers.
+ */
+
+typedef struct _twin_rect_edge {
+    twin_sfixed_t   x, top, bot;
+    int		    winding;
+} twin_rect_edge_t;
+
+typedef struct _twin_rect_fill {
+    twin_pixmap_t   *dst;
+    twin_operand_t  *src;
+    twin_coord_t    src_x, src_y;
+    twin_coord_t    left;	/* column of acc[0] and cover[0] */
+    uint16_t	    *acc;	/* coverage in 1/256 pixel */
+    twin_coord_t    acc_left, acc_right;
+    twin_coord_t    row;	/* pixel row of partial coverage in acc */
+    twin_a8_t	    *cover;
+    twin_pixmap_t   line;	/* cover as a mask, every row alike */
+} twin_rect_fill_t;
+
+static int
+_twin_rect_edge_compare (const void *a, const void *b)
+{
+    const twin_rect_edge_t  *ea = a, *eb = b;
+
+    return ea->x - eb->x;
+}
+
+static int
+_twin_rect_y_compare (const void *a, const void *b)
+{
+    return *(const twin_sfixed_t *) a - *(const twin_sfixed_t *) b;
+}
+
+/*
+ * Collect the vertical edges of path, returning how many or -1 when
+ * some edge is neither vertical nor horizontal
+ */
+static int
+_twin_rect_edges (twin_path_t *path, twin_rect_edge_t *edges)
+{
+    int		    s, p, v, nv, npoints, sublen;
+    twin_spoint_t   *a, *b;
+    int		    n = 0;
+
+    p = 0;
+    for (s = 0; s <= path->nsublen; s++)
+    {
+	if (s == path->nsublen)
+	    sublen = path->npoints;
+	else
+	    sublen = path->sublen[s];
+	npoints = sublen - p;
+	if (npoints <= 1)
+	    continue;
+	for (v = 0; v < npoints; v++)
+	{
+	    nv = v + 1;
+	    if (nv == npoints) nv = 0;
+	    a = &path->points[p + v];
+	    b = &path->points[p + nv];
+	    if (a->y == b->y)
+		continue;
+	    if (a->x != b->x)
+		return -1;
+	    edges[n].x = a->x;
+	    if (a->y < b->y)
+	    {
+		edges[n].top = a->y;
+		edges[n].bot = b->y;
+		edges[n].winding = 1;
+	    }
+	    else
+	    {
+		edges[n].top = b->y;
+		edges[n].bot = a->y;
+		edges[n].winding = -1;
+	    }
+	    n++;
+	}
+	p = sublen;
+    }
+    return n;
+}
+
+/*
+ * Add h/16 of a row of the span from x0 to x1 into acc
+ */
+static void
+_twin_rect_add (twin_rect_fill_t *f, twin_sfixed_t x0, twin_sfixed_t x1,
+		int h)
+{
+    twin_coord_t    c0 = twin_sfixed_trunc (x0) - f->left;
+    twin_coord_t    c1 = twin_sfixed_trunc (x1) - f->left;
+    twin_coord_t    c;
+
+    if (c0 < f->acc_left)
+	f->acc_left = c0;
+    if (c1 + (twin_sfixed_mod (x1) != 0) > f->acc_right)
+	f->acc_right = c1 + (twin_sfixed_mod (x1) != 0);
+    if (c0 == c1)
+    {
+	f->acc[c0] += h * (x1 - x0);
+	return;
+    }
+    f->acc[c0] += h * (TWIN_SFIXED_ONE - twin_sfixed_mod (x0));
+    for (c = c0 + 1; c < c1; c++)
+	f->acc[c] += h * TWIN_SFIXED_ONE;
+    if (twin_sfixed_mod (x1))
+	f->acc[c1] += h * twin_sfixed_mod (x1);
+}
+
+/*
+ * Composite height rows from y through the summed coverage, then
+ * clear it.  Full runs need no mask at all and empty ones are
+ * skipped, which leaves dst alone under OVER.
+ */
+static void
+_twin_rect_emit (twin_rect_fill_t *f, twin_coord_t y, twin_coord_t height)
+{
+    twin_operand_t  msk;
+    twin_coord_t    c, run;
+    twin_a8_t	    a;
+
+    if (f->acc_left >= f->acc_right)
+	return;
+    for (c = f->acc_left; c < f->acc_right; c++)
+    {
+	f->cover[c] = (f->acc[c] * 255 + 128) >> 8;
+	f->acc[c] = 0;
+    }
+    msk.source_kind = TWIN_PIXMAP;
+    msk.u.pixmap = &f->line;
+    for (c = f->acc_left; c < f->acc_right; c = run)
+    {
+	a = f->cover[c];
+	for (run = c + 1; run < f->acc_right; run++)
+	    if ((f->cover[run] == 0xff) != (a == 0xff) ||
+		(f->cover[run] == 0) != (a == 0))
+		break;
+	if (a == 0)
+	    continue;
+	twin_composite (f->dst, f->left + c, y,
+			f->src, f->src_x + f->left + c, f->src_y + y,
+			a == 0xff ? NULL : &msk, c, 0,
+			TWIN_OVER, run - c, height);
+    }
+    f->acc_left = f->line.width;
+    f->acc_right = 0;
+}
+
+/*
+ * Switch the partial row being summed, finishing the last one
+ */
+static void
+_twin_rect_row (twin_rect_fill_t *f, twin_coord_t row)
+{
+    if (f->row != row)
+    {
+	_twin_rect_emit (f, f->row, 1);
+	f->row = row;
+    }
+}
+
+/*
+ * OVER the coverage of a path made of horizontal and vertical edges,
+ * returning FALSE, with nothing drawn, for any other path
+ */
+twin_bool_t
+_twin_rect_composite_path (twin_pixmap_t	*dst,
+			   twin_operand_t	*src,
+			   twin_coord_t		src_x,
+			   twin_coord_t		src_y,
+			   twin_path_t		*path,
+			   twin_rect_t		*bounds)
+{
+    twin_coord_t	width = bounds->right - bounds->left;
+    twin_coord_t	height = bounds->bottom - bounds->top;
+    twin_rect_edge_t	*edges;
+    twin_sfixed_t	*ys, *spans;
+    twin_sfixed_t	clip_left, clip_top, clip_right, clip_bottom;
+    twin_sfixed_t	ya, yb, y, x0 = 0;
+    twin_pointer_t	cover;
+    twin_rect_fill_t	f;
+    int			n, nys, nspans, b, i, k, w;
+
+    edges = _twin_scratch_alloc (TWIN_SCRATCH_PATH,
+				 path->npoints * (sizeof (twin_rect_edge_t) +
+						  4 * sizeof (twin_sfixed_t)) +
+				 width * (sizeof (uint16_t) + 1));
+    if (!edges)
+	return TWIN_FALSE;
+    n = _twin_rect_edges (path, edges);
+    if (n < 0)
+	return TWIN_FALSE;
+    ys = (twin_sfixed_t *) (edges + path->npoints);
+    spans = ys + 2 * path->npoints;
+    f.acc = (uint16_t *) (spans + 2 * path->npoints);
+    f.cover = (twin_a8_t *) (f.acc + width);
+
+    nys = 0;
+    for (i = 0; i < n; i++)
+    {
+	/* without antialiasing, only whole pixels can be drawn here */
+	if (dst->antialias == TWIN_ANTIALIAS_NONE &&
+	    (twin_sfixed_mod (edges[i].x) ||
+	     twin_sfixed_mod (edges[i].top) ||
+	     twin_sfixed_mod (edges[i].bot)))
+	    return TWIN_FALSE;
+	ys[nys++] = edges[i].top;
+	ys[nys++] = edges[i].bot;
+    }
+    qsort (edges, n, sizeof (twin_rect_edge_t), _twin_rect_edge_compare);
+    qsort (ys, nys, sizeof (twin_sfixed_t), _twin_rect_y_compare);
+
+    memset (f.acc, '\0', width * sizeof (uint16_t));
+    f.dst = dst;
+    f.src = src;
+    f.src_x = src_x;
+    f.src_y = src_y;
+    f.left = bounds->left;
+    f.row = bounds->top;
+    cover.a8 = f.cover;
+    _twin_pixmap_init (&f.line, TWIN_A8, width, height, 0, cover);
+    f.acc_left = width;
+    f.acc_right = 0;
+
+    /* draw only within the clip, in the pixmap's own coordinates */
+    clip_left = twin_int_to_sfixed (dst->clip.left - dst->origin_x);
+    clip_top = twin_int_to_sfixed (dst->clip.top - dst->origin_y);
+    clip_right = twin_int_to_sfixed (dst->clip.right - dst->origin_x);
+    clip_bottom = twin_int_to_sfixed (dst->clip.bottom - dst->origin_y);
+
+    for (b = 0; b + 1 < nys; b++)
+    {
+	ya = ys[b];
+	yb = ys[b + 1];
+	if (ya < clip_top)
+	    ya = clip_top;
+	if (yb > clip_bottom)
+	    yb = clip_bottom;
+	if (ya >= yb)
+	    continue;
+
+	/* the covered spans of this band */
+	nspans = 0;
+	w = 0;
+	for (i = 0; i < n; i++)
+	{
+	    if (edges[i].top > ya || edges[i].bot < yb)
+		continue;
+	    if (w == 0)
+		x0 = edges[i].x;
+	    w += edges[i].winding;
+	    if (w == 0)
+	    {
+		if (x0 < clip_left)
+		    x0 = clip_left;
+		if (x0 < edges[i].x && x0 < clip_right)
+		{
+		    spans[nspans++] = x0;
+		    spans[nspans++] = edges[i].x < clip_right ?
+				      edges[i].x : clip_right;
+		}
+	    }
+	}
+	if (!nspans)
+	    continue;
+
+	/* a partial row at the top */
+	y = ya;
+	if (twin_sfixed_mod (y))
+	{
+	    twin_sfixed_t   e = twin_sfixed_floor (y) + TWIN_SFIXED_ONE;
+
+	    if (e > yb)
+		e = yb;
+	    _twin_rect_row (&f, twin_sfixed_trunc (y));
+	    for (k = 0; k < nspans; k += 2)
+		_twin_rect_add (&f, spans[k], spans[k + 1], e - y);
+	    y = e;
+	}
+
+	/* whole rows, all alike */
+	if (twin_sfixed_floor (yb) > y)
+	{
+	    _twin_rect_emit (&f, f.row, 1);
+	    for (k = 0; k < nspans; k += 2)
+		_twin_rect_add (&f, spans[k], spans[k + 1], TWIN_SFIXED_ONE);
+	    _twin_rect_emit (&f, twin_sfixed_trunc (y),
+			     twin_sfixed_trunc (twin_sfixed_floor (yb) - y));
+	    y = twin_sfixed_floor (yb);
+	}
+
+	/* and a partial row at the bottom */
+	if (y < yb)
+	{
+	    _twin_rect_row (&f, twin_sfixed_trunc (y));
+	    for (k = 0; k < nspans; k += 2)
+		_twin_rect_add (&f, spans[k], spans[k + 1], yb - y);
+	}
+    }
+    _twin_rect_emit (&f, f.row, 1);
+    return TWIN_TRUE;
+}
@@ -0,0 +1,170 @@
+/*
+ * Twin - A Tiny Window System
+ * Copyright © 2004 Keith Packard <keithp@keithp.com>
+ * All rights reserved.
+ *
+ * This Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with the Twin Library; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "twinint.h"
+
+/*
+ * Regions are a short list of disjoint rectangles.  Adding a
+ * rectangle which overlaps an existing one merges the two into their
+ * bounding box, so the list stays disjoint.  Nearby rectangles are
+ * also merged when the bounding box wastes few pixels; drawing a
+ * handful of extra pixels is cheaper than another pass through the
+ * compositor.  When the list is full, the pair wasting the fewest
+ * pixels is merged.
+ */
+
+#define TWIN_REGION_WASTE   (32 * 32)
+
+static twin_area_t
+_twin_rect_area (const twin_rect_t *r)
+{
+    return (twin_area_t) (r->right - r->left) * (r->bottom - r->top);
+}
+
+static void
+_twin_rect_union (twin_rect_t *d, const twin_rect_t *s)
+{
+    if (s->left < d->left)
+	d->left = s->left;
+    if (s->top < d->top)
+	d->top = s->top;
+    if (s->right > d->right)
+	d->right = s->right;
+    if (s->bottom > d->bottom)
+	d->bottom = s->bottom;
+}
+
+static twin_bool_t
+_twin_rect_overlap (const twin_rect_t *a, const twin_rect_t *b)
+{
+    return (a->left < b->right && b->left < a->right &&
+	    a->top < b->bottom && b->top < a->bottom);
+}
+
+/*
+ * Pixels in the bounding box of a and b not covered by either
+ */
+static twin_area_t
+_twin_rect_waste (const twin_rect_t *a, const twin_rect_t *b)
+{
+    twin_rect_t	u = *a;
+
+    _twin_rect_union (&u, b);
+    return _twin_rect_area (&u) - _twin_rect_area (a) - _twin_rect_area (b);
+}
+
+static void
+_twin_region_remove (twin_region_t *region, int i)
+{
+    region->rects[i] = region->rects[--region->nrects];
+}
+
+void
+twin_region_init (twin_region_t *region)
+{
+    region->nrects = 0;
+    region->extents.left = region->extents.right = 0;
+    region->extents.top = region->extents.bottom = 0;
+}
+
+twin_bool_t
+twin_region_is_empty (twin_region_t *region)
+{
+    return region->nrects == 0;
+}
+
+void
+twin_region_union_rect (twin_region_t	*region,
+			twin_coord_t	left,	twin_coord_t top,
+			twin_coord_t	right,	twin_coord_t bottom)
+{
+    twin_rect_t	r;
+    int		i, best;
+    twin_area_t	waste, best_waste;
+
+    if (left >= right || top >= bottom)
+	return;
+    r.left = left;
+    r.top = top;
+    r.right = right;
+    r.bottom = bottom;
+
+    if (region->nrects == 0)
+	region->extents = r;
+    else
+	_twin_rect_union (&region->extents, &r);
+
+    for (;;)
+    {
+	/* swallow anything touching the new rectangle */
+	for (i = 0; i < region->nrects; i++)
+	{
+	    twin_rect_t	*o = &region->rects[i];
+
+	    if (_twin_rect_overlap (o, &r) ||
+		_twin_rect_waste (o, &r) <= TWIN_REGION_WASTE)
+	    {
+		_twin_rect_union (&r, o);
+		_twin_region_remove (region, i);
+		/* the merged rectangle may now reach earlier entries */
+		i = -1;
+	    }
+	}
+	if (region->nrects < TWIN_REGION_RECTS)
+	    break;
+
+	/* full, merge with the cheapest neighbor and try again */
+	best = 0;
+	best_waste = _twin_rect_waste (&region->rects[0], &r);
+	for (i = 1; i < region->nrects; i++)
+	{
+	    waste = _twin_rect_waste (&region->rects[i], &r);
+	    if (waste < best_waste)
+	    {
+		best = i;
+		best_waste = waste;
+	    }
+	}
+	_twin_rect_union (&r, &region->rects[best]);
+	_twin_region_remove (region, best);
+    }
+    region->rects[region->nrects++] = r;
+}
+
+twin_bool_t
+twin_region_intersects (twin_region_t	*region,
+			twin_coord_t	left,	twin_coord_t top,
+			twin_coord_t	right,	twin_coord_t bottom)
+{
+    twin_rect_t	r;
+    int		i;
+
+    r.left = left;
+    r.top = top;
+    r.right = right;
+    r.bottom = bottom;
+    if (!region->nrects || !_twin_rect_overlap (&region->extents, &r))
+	return TWIN_FALSE;
+    for (i = 0; i < region->nrects; i++)
+	if (_twin_rect_overlap (&region->rects[i], &r))
+	    return TWIN_TRUE;
+    return TWIN_FALSE;
+}
@@ -0,0 +1,156 @@
+/*
+ * Twin - A Tiny Window System
+ * Copyright © 2004 Keith Packard <keithp@keithp.com>
+ * All rights reserved.
+ *
+ * This Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with the Twin Library; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "twinint.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/*
+ * Span sized buffers for compositing, kept by each thread and grown
+ * to the largest size asked for rather than allocated every time
+ */
+
+typedef struct _twin_scratch {
+    void		    *buf[TWIN_SCRATCH_SLOTS];
+    size_t		    size[TWIN_SCRATCH_SLOTS];
+    twin_scratch_stats_t    stats;
+} twin_scratch_t;
+
+static void
+_twin_scratch_free (twin_scratch_t *scratch)
+{
+    int	i;
+
+    for (i = 0; i < TWIN_SCRATCH_SLOTS; i++)
+	free (scratch->buf[i]);
+    free (scratch);
+}
+
+#ifdef HAVE_PTHREAD
+
+static pthread_key_t	scratch_key;
+static pthread_once_t	scratch_once = PTHREAD_ONCE_INIT;
+
+static void
+_twin_scratch_destroy (void *closure)
+{
+    _twin_scratch_free (closure);
+}
+
+static void
+_twin_scratch_key (void)
+{
+    pthread_key_create (&scratch_key, _twin_scratch_destroy);
+}
+
+static twin_scratch_t *
+_twin_scratch_get (twin_bool_t create)
+{
+    twin_scratch_t  *scratch;
+
+    pthread_once (&scratch_once, _twin_scratch_key);
+    scratch = pthread_getspecific (scratch_key);
+    if (!scratch && create)
+    {
+	scratch = calloc (1, sizeof (twin_scratch_t));
+	if (scratch)
+	    pthread_setspecific (scratch_key, scratch);
+    }
+    return scratch;
+}
+
+static void
+_twin_scratch_set (twin_scratch_t *scratch)
+{
+    pthread_setspecific (scratch_key, scratch);
+}
+
+#else
+
+static twin_scratch_t	*scratch_only;
+
+static twin_scratch_t *
+_twin_scratch_get (twin_bool_t create)
+{
+    if (!scratch_only && create)
+	scratch_only = calloc (1, sizeof (twin_scratch_t));
+    return scratch_only;
+}
+
+static void
+_twin_scratch_set (twin_scratch_t *scratch)
+{
+    scratch_only = scratch;
+}
+
+#endif
+
+/*
+ * Return a buffer of at least size bytes for slot, valid until
+ * the same thread asks for that slot again
+ */
+void *
+_twin_scratch_alloc (int slot, size_t size)
+{
+    twin_scratch_t  *scratch = _twin_scratch_get (TWIN_TRUE);
+    void	    *buf;
+
+    if (!scratch)
+	return NULL;
+    if (size > scratch->size[slot])
+    {
+	/* the old contents are not needed, so skip realloc's copy */
+	buf = malloc (size);
+	if (!buf)
+	    return NULL;
+	free (scratch->buf[slot]);
+	scratch->stats.bytes += size - scratch->size[slot];
+	scratch->buf[slot] = buf;
+	scratch->size[slot] = size;
+	scratch->stats.grows++;
+    }
+    scratch->stats.uses++;
+    return scratch->buf[slot];
+}
+
+void
+twin_scratch_get_stats (twin_scratch_stats_t *stats)
+{
+    twin_scratch_t  *scratch = _twin_scratch_get (TWIN_FALSE);
+
+    if (scratch)
+	*stats = scratch->stats;
+    else
+	memset (stats, '\0', sizeof (twin_scratch_stats_t));
+}
+
+void
+twin_scratch_release (void)
+{
+    twin_scratch_t  *scratch = _twin_scratch_get (TWIN_FALSE);
+
+    if (!scratch)
+	return;
+    _twin_scratch_set (NULL);
+    _twin_scratch_free (scratch);
+}
@@ -21,6 +21,11 @@
 
 #include "twinint.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 twin_screen_t *
 twin_screen_create (twin_coord_t	width,
 		    twin_coord_t	height, 
@@ -35,28 +40,245 @@ twin_screen_create (twin_coord_t	width,
     screen->bottom = 0;
     screen->width = width;
     screen->height = height;
-    screen->damage.left = screen->damage.right = 0;
-    screen->damage.top = screen->damage.bottom = 0;
+    screen->format = TWIN_ARGB32;
+    twin_region_init (&screen->damage);
     screen->damaged = NULL;
     screen->damaged_closure = NULL;
     screen->disable = 0;
+    screen->frame_interval = -1;
     screen->background = 0;
     screen->put_begin = put_begin;
     screen->put_span = put_span;
     screen->closure = closure;
+    _twin_grid_resize (screen);
 
     screen->button_x = screen->button_y = -1;
     return screen;
 }
 
+static twin_bool_t
+twin_screen_cursor_overlaid (twin_screen_t *screen)
+{
+    return screen->cursor_overlay && screen->direct;
+}
+
+static void
+twin_screen_free_shadow (twin_screen_t *screen)
+{
+    if (screen->direct_shadow)
+	free (screen->direct);
+    screen->direct = NULL;
+    screen->direct_stride = 0;
+    screen->direct_shadow = TWIN_FALSE;
+}
+
 void
 twin_screen_destroy (twin_screen_t *screen)
 {
     while (screen->bottom)
 	twin_pixmap_hide (screen->bottom);
+    _twin_grid_fini (screen);
+    twin_screen_set_frame_interval (screen, -1);
+    twin_screen_set_threads (screen, 1);
+    twin_screen_free_shadow (screen);
+    free (screen->under);
+    free (screen->buffer);
     free (screen);
 }
 
+void
+twin_screen_set_put_rect (twin_screen_t	*screen,
+			  twin_get_rect_t	get_rect,
+			  twin_put_rect_t	put_rect)
+{
+    screen->get_rect = get_rect;
+    screen->put_rect = put_rect;
+}
+
+void
+twin_screen_set_put_frame (twin_screen_t	*screen,
+			   twin_put_frame_t	begin_frame,
+			   twin_put_frame_t	end_frame)
+{
+    screen->begin_frame = begin_frame;
+    screen->end_frame = end_frame;
+}
+
+void
+twin_screen_set_copy_rect (twin_screen_t	*screen,
+			   twin_copy_rect_t	copy_rect)
+{
+    screen->copy_rect = copy_rect;
+}
+
+void
+twin_screen_set_direct (twin_screen_t	*screen,
+			twin_argb32_t	*pixels,
+			twin_coord_t	stride)
+{
+    twin_screen_free_shadow (screen);
+    /* any cursor drawn was in the old target */
+    screen->cursor_drawn = TWIN_FALSE;
+    screen->direct = pixels;
+    screen->direct_stride = pixels ? stride : 0;
+    if (pixels)
+	twin_screen_damage (screen, 0, 0, screen->width, screen->height);
+}
+
+/*
+ * Move to another target already holding the same pixels, as
+ * when flipping between pages kept in step by the backend
+ */
+void
+twin_screen_swap_direct (twin_screen_t *screen, twin_argb32_t *pixels)
+{
+    screen->direct = pixels;
+}
+
+twin_bool_t
+twin_screen_set_shadow (twin_screen_t *screen, twin_bool_t shadow)
+{
+    twin_argb32_t   *pixels;
+
+    if (shadow == screen->direct_shadow)
+	return TWIN_TRUE;
+    if (!shadow)
+    {
+	twin_screen_free_shadow (screen);
+	return TWIN_TRUE;
+    }
+    pixels = malloc ((twin_area_t) screen->width * screen->height *
+		     twin_bytes_per_pixel (screen->format));
+    if (!pixels)
+	return TWIN_FALSE;
+    twin_screen_set_direct (screen, pixels,
+			    screen->width *
+			    twin_bytes_per_pixel (screen->format));
+    screen->direct_shadow = TWIN_TRUE;
+    return TWIN_TRUE;
+}
+
+/*
+ * Compose the screen in another format; an RGB16 screen lets RGB16
+ * pixmaps be copied straight to 16bpp displays
+ */
+twin_bool_t
+twin_screen_set_format (twin_screen_t *screen, twin_format_t format)
+{
+    twin_bool_t	    shadow = screen->direct_shadow;
+
+    if (format != TWIN_ARGB32 && format != TWIN_RGB16)
+	return TWIN_FALSE;
+    if (format == screen->format)
+	return TWIN_TRUE;
+    /* targets hold pixels of the old format */
+    twin_screen_free_shadow (screen);
+    screen->cursor_drawn = TWIN_FALSE;
+    screen->move_pixmap = NULL;
+    screen->format = format;
+    twin_screen_damage (screen, 0, 0, screen->width, screen->height);
+    if (shadow)
+	return twin_screen_set_shadow (screen, TWIN_TRUE);
+    return TWIN_TRUE;
+}
+
+twin_format_t
+twin_screen_get_format (twin_screen_t *screen)
+{
+    return screen->format;
+}
+
+static void
+twin_screen_frame (twin_screen_t *screen);
+
+static twin_time_t
+twin_screen_frame_timeout (twin_time_t now, void *closure)
+{
+    twin_screen_t   *screen = closure;
+
+    screen->frame_timeout = NULL;
+    twin_screen_frame (screen);
+    return -1;
+}
+
+static twin_bool_t
+twin_screen_frame_work (void *closure)
+{
+    twin_screen_t   *screen = closure;
+
+    screen->frame_work = NULL;
+    twin_screen_frame (screen);
+    return TWIN_FALSE;
+}
+
+/*
+ * Update the screen unless the last frame was too recent, in
+ * which case wait until the next one is due
+ */
+static void
+twin_screen_frame (twin_screen_t *screen)
+{
+    twin_time_t	now, wait;
+
+    if (screen->disable || !twin_screen_damaged (screen))
+	return;
+    now = twin_now ();
+    wait = screen->frame_last + screen->frame_interval - now;
+    if (wait > 0 && wait <= screen->frame_interval)
+    {
+	if (!screen->frame_timeout)
+	    screen->frame_timeout = twin_set_timeout (twin_screen_frame_timeout,
+						      wait, screen);
+	return;
+    }
+    screen->frame_last = now;
+    twin_screen_update (screen);
+}
+
+/*
+ * Damage arrived; queue a frame to pick up everything damaged
+ * before the dispatcher gets back around to redisplay
+ */
+static void
+twin_screen_schedule_frame (twin_screen_t *screen)
+{
+    if (screen->frame_interval < 0)
+	return;
+    if (screen->frame_work || screen->frame_timeout)
+	return;
+    screen->frame_work = twin_set_work (twin_screen_frame_work,
+					TWIN_WORK_REDISPLAY, screen);
+}
+
+/*
+ * Tell whoever is updating the screen that there's work to do
+ */
+static void
+twin_screen_notify_damaged (twin_screen_t *screen)
+{
+    twin_screen_schedule_frame (screen);
+    if (screen->damaged)
+	(*screen->damaged) (screen->damaged_closure);
+}
+
+void
+twin_screen_set_frame_interval (twin_screen_t *screen, twin_time_t interval)
+{
+    if (interval < 0)
+    {
+	if (screen->frame_work)
+	    twin_clear_work (screen->frame_work);
+	if (screen->frame_timeout)
+	    twin_clear_timeout (screen->frame_timeout);
+	screen->frame_work = NULL;
+	screen->frame_timeout = NULL;
+	interval = -1;
+    }
+    screen->frame_interval = interval;
+    if (!screen->disable && twin_screen_damaged (screen))
+	twin_screen_schedule_frame (screen);
+}
+
 void
 twin_screen_register_damaged (twin_screen_t *screen, 
 			      void (*damaged) (void *),
@@ -71,12 +293,8 @@ twin_screen_enable_update (twin_screen_t *screen)
 {
     if (--screen->disable == 0)
     {
-	if (screen->damage.left < screen->damage.right &&
-	    screen->damage.top < screen->damage.bottom)
-	{
-	    if (screen->damaged)
-		(*screen->damaged) (screen->damaged_closure);
-	}
+	if (twin_screen_damaged (screen))
+	    twin_screen_notify_damaged (screen);
     }
 }
 
@@ -101,27 +319,12 @@ twin_screen_damage (twin_screen_t *screen,
 	right = screen->width;
     if (bottom > screen->height)
 	bottom = screen->height;
+    if (left >= right || top >= bottom)
+	return;
 
-    if (screen->damage.left == screen->damage.right)
-    {
-	screen->damage.left = left;
-	screen->damage.right = right;
-	screen->damage.top = top;
-	screen->damage.bottom = bottom;
-    }
-    else
-    {
-	if (left < screen->damage.left)
-	    screen->damage.left = left;
-	if (top < screen->damage.top)
-	    screen->damage.top = top;
-	if (screen->damage.right < right)
-	    screen->damage.right = right;
-	if (screen->damage.bottom < bottom)
-	    screen->damage.bottom = bottom;
-    }
-    if (screen->damaged && !screen->disable)
-	(*screen->damaged) (screen->damaged_closure);
+    twin_region_union_rect (&screen->damage, left, top, right, bottom);
+    if (!screen->disable)
+	twin_screen_notify_damaged (screen);
 }
 
 void
@@ -130,21 +333,108 @@ twin_screen_resize (twin_screen_t *screen,
 {
     screen->width = width;
     screen->height = height;
+    if (screen->direct_shadow)
+    {
+	twin_screen_free_shadow (screen);
+	twin_screen_set_shadow (screen, TWIN_TRUE);
+    }
+    _twin_grid_resize (screen);
     twin_screen_damage (screen, 0, 0, screen->width, screen->height);
 }
 
 twin_bool_t
 twin_screen_damaged (twin_screen_t *screen)
 {
-    return (screen->damage.left < screen->damage.right &&
-	    screen->damage.top < screen->damage.bottom);
+    return (!twin_region_is_empty (&screen->damage) ||
+	    screen->move_pixmap ||
+	    (screen->cursor_moved && twin_screen_cursor_overlaid (screen)));
+}
+
+/*
+ * A shown pixmap is about to move; it can be shifted on the screen
+ * if it covers whatever is beneath it and nothing else is moving
+ */
+twin_bool_t
+_twin_screen_copy_pixmap (twin_screen_t *screen, twin_pixmap_t *pixmap)
+{
+    if (screen->move_pixmap == pixmap)
+	return TWIN_TRUE;
+    if (screen->move_pixmap || !pixmap->opaque)
+	return TWIN_FALSE;
+    if (!screen->direct && !screen->copy_rect)
+	return TWIN_FALSE;
+    screen->move_pixmap = pixmap;
+    screen->move_x = pixmap->x;
+    screen->move_y = pixmap->y;
+    return TWIN_TRUE;
+}
+
+/*
+ * The pixmap is going away before its move reached the screen
+ */
+void
+_twin_screen_drop_copy (twin_screen_t *screen, twin_pixmap_t *pixmap)
+{
+    if (screen->move_pixmap != pixmap)
+	return;
+    screen->move_pixmap = NULL;
+    twin_screen_damage (screen, screen->move_x, screen->move_y,
+			screen->move_x + pixmap->width,
+			screen->move_y + pixmap->height);
+}
+
+static twin_argb32_t *
+twin_screen_row (twin_argb32_t *pixels, twin_coord_t stride, twin_coord_t row)
+{
+    return (twin_argb32_t *) ((twin_a8_t *) pixels + row * stride);
+}
+
+/*
+ * Pixel x along a row in the screen format; spans and targets hold
+ * twin_rgb16_t pixels on an RGB16 screen, whatever their type
+ */
+static twin_argb32_t *
+twin_screen_pixel (twin_screen_t *screen, twin_argb32_t *row, twin_coord_t x)
+{
+    return (twin_argb32_t *) ((twin_a8_t *) row +
+			      x * twin_bytes_per_pixel (screen->format));
+}
+
+/*
+ * Operators putting each pixmap format onto the screen format
+ */
+typedef struct _twin_screen_ops {
+    twin_src_op	    source[3];
+    twin_src_op	    over[3];
+} twin_screen_ops_t;
+
+static void
+twin_screen_ops_init (twin_screen_t *screen, twin_screen_ops_t *ops)
+{
+    twin_format_t   format;
+
+    for (format = TWIN_A8; format <= TWIN_ARGB32; format++)
+    {
+	ops->source[format] = _twin_draw_op (TWIN_SOURCE, format,
+					     screen->format);
+	ops->over[format] = _twin_draw_op (TWIN_OVER, format, screen->format);
+    }
+}
+
+/* opaque pixels land on whatever is there */
+static twin_src_op
+twin_screen_pixmap_op (const twin_screen_ops_t *ops, twin_pixmap_t *p)
+{
+    if (p->format == TWIN_RGB16 || p->opaque)
+	return ops->source[p->format];
+    return ops->over[p->format];
 }
 
 static void
 twin_screen_span_pixmap(twin_screen_t *screen, twin_argb32_t *span,
 			twin_pixmap_t *p, twin_coord_t y,
 			twin_coord_t left, twin_coord_t right,
-			twin_src_op op16, twin_src_op op32)
+			const twin_screen_ops_t *ops)
 {
     twin_pointer_t  dst;
     twin_source_u   src;
@@ -164,94 +454,880 @@ twin_screen_span_pixmap(twin_screen_t *screen, twin_argb32_t *span,
 	p_right = p->x + p->width;
     if (p_left >= p_right)
 	return;
-    dst.argb32 = span + (p_left - left);
+    dst.argb32 = twin_screen_pixel (screen, span, p_left - left);
     src.p = twin_pixmap_pointer (p, p_left - p->x, y - p->y);
-    if (p->format == TWIN_RGB16)
-	op16 (dst, src, p_right - p_left);
+    twin_screen_pixmap_op (ops, p) (dst, src, p_right - p_left);
+}
+
+/*
+ * The piece of a pixmap left showing on one row once the opaque
+ * pixmaps above it have been accounted for
+ */
+typedef struct _twin_screen_layer {
+    twin_pixmap_t   *pixmap;
+    twin_coord_t    left, right;
+} twin_screen_layer_t;
+
+static void
+twin_screen_span_background (twin_screen_t *screen, twin_argb32_t *span,
+			     twin_coord_t y, twin_coord_t span_left,
+			     twin_coord_t left, twin_coord_t right,
+			     const twin_screen_ops_t *ops)
+{
+    twin_pointer_t  dst;
+    twin_source_u   src;
+
+    if (left >= right)
+	return;
+    if (!screen->background)
+    {
+	memset (twin_screen_pixel (screen, span, left - span_left), 0xff,
+		(right - left) * twin_bytes_per_pixel (screen->format));
+	return;
+    }
+    /* the background's extend mode covers the rest of the screen */
+    src.p = _twin_pixmap_span (screen->background, left, y, right - left,
+			       TWIN_SCRATCH_SRC);
+    if (!src.p.v)
+	return;
+    dst.argb32 = twin_screen_pixel (screen, span, left - span_left);
+    ops->source[screen->background->format] (dst, src, right - left);
+}
+
+/*
+ * One damaged rectangle being composed
+ */
+typedef struct _twin_screen_compose {
+    twin_screen_t	*screen;
+    twin_coord_t	left, top, right, bottom;
+    twin_pixmap_t	**visible;
+    int			nvisible;
+    const twin_screen_ops_t *ops;
+} twin_screen_compose_t;
+
+static void
+twin_screen_compose_row (twin_screen_compose_t *c, twin_screen_layer_t *layers,
+			 twin_coord_t y, twin_argb32_t *span)
+{
+    twin_screen_t	*screen = c->screen;
+    twin_coord_t	left = c->left;
+    twin_coord_t	right = c->right;
+    twin_pixmap_t	*p;
+    int			nlayers, i;
+    /*
+     * Walk down the stack tracking the widest run of opaque
+     * pixels seen so far; anything entirely within that run is
+     * skipped, anything poking out one end is trimmed
+     */
+    twin_coord_t	o_left = left, o_right = left;
+
+    nlayers = 0;
+    for (i = 0; i < c->nvisible; i++)
+    {
+	twin_coord_t    p_left, p_right;
+	twin_coord_t    l, r;
+
+	p = c->visible[i];
+	if (y < p->y || p->y + p->height <= y)
+	    continue;
+	p_left = p->x < left ? left : p->x;
+	p_right = p->x + p->width > right ? right : p->x + p->width;
+	if (o_left <= p_left && p_right <= o_right)
+	    continue;
+
+	l = p_left;
+	r = p_right;
+	if (o_left <= l && l < o_right)
+	    l = o_right;
+	else if (o_left < r && r <= o_right)
+	    r = o_left;
+	layers[nlayers].pixmap = p;
+	layers[nlayers].left = l;
+	layers[nlayers].right = r;
+	nlayers++;
+
+	if (p->opaque)
+	{
+	    if (o_left < o_right && p_left <= o_right && o_left <= p_right)
+	    {
+		if (p_left < o_left)
+		    o_left = p_left;
+		if (p_right > o_right)
+		    o_right = p_right;
+	    }
+	    else if (p_right - p_left > o_right - o_left)
+	    {
+		o_left = p_left;
+		o_right = p_right;
+	    }
+	    if (o_left <= left && right <= o_right)
+		break;
+	}
+    }
+
+    if (o_left == o_right)
+	twin_screen_span_background (screen, span, y, left,
+				     left, right, c->ops);
     else
-	op32 (dst, src, p_right - p_left);
+    {
+	twin_screen_span_background (screen, span, y, left,
+				     left, o_left, c->ops);
+	twin_screen_span_background (screen, span, y, left,
+				     o_right, right, c->ops);
+    }
+
+    while (nlayers--)
+    {
+	twin_screen_layer_t	*layer = &layers[nlayers];
+	twin_pointer_t		dst;
+	twin_source_u		src;
+
+	p = layer->pixmap;
+	dst.argb32 = twin_screen_pixel (screen, span, layer->left - left);
+	src.p = twin_pixmap_pointer (p, layer->left - p->x, y - p->y);
+	twin_screen_pixmap_op (c->ops, p) (dst, src,
+					   layer->right - layer->left);
+    }
+
+    if (screen->cursor && !twin_screen_cursor_overlaid (screen))
+	twin_screen_span_pixmap(screen, span, screen->cursor,
+				y, left, right, c->ops);
 }
 
+#ifdef HAVE_PTHREAD
+
+/*
+ * Large rectangles are cut into bands of rows handed out to a pool
+ * of threads, each composing into its own part of a shared buffer.
+ * The finished rows are then delivered to put_span in order from
+ * the thread calling twin_screen_update, so backends never see
+ * more than one thread.
+ */
+
+#define TWIN_SCREEN_BAND_ROWS	16
+#define TWIN_SCREEN_THREAD_AREA	(128 * 128)
+
+typedef struct _twin_screen_worker {
+    struct _twin_screen_threads	*threads;
+    int				index;
+    pthread_t			thread;
+} twin_screen_worker_t;
+
+struct _twin_screen_threads {
+    pthread_mutex_t		lock;
+    pthread_cond_t		start;
+    pthread_cond_t		done;
+    int				nworkers;
+    twin_screen_worker_t	*workers;
+    unsigned long		generation;
+    int				busy;
+    twin_bool_t			quit;
+
+    /* the rectangle being composed */
+    twin_screen_compose_t	*compose;
+    int				next_band, nbands;
+    twin_screen_layer_t		*layers;
+    int				nlayers;
+    twin_argb32_t		*pixels;
+    twin_coord_t		stride;
+};
+
+static void
+twin_screen_run_bands (twin_screen_threads_t *t, twin_screen_layer_t *layers)
+{
+    twin_screen_compose_t   *c = t->compose;
+    twin_coord_t	    y, bottom;
+    int			    band;
+
+    for (;;)
+    {
+	pthread_mutex_lock (&t->lock);
+	band = t->next_band++;
+	pthread_mutex_unlock (&t->lock);
+	if (band >= t->nbands)
+	    break;
+	y = c->top + band * TWIN_SCREEN_BAND_ROWS;
+	bottom = y + TWIN_SCREEN_BAND_ROWS;
+	if (bottom > c->bottom)
+	    bottom = c->bottom;
+	for (; y < bottom; y++)
+	    twin_screen_compose_row (c, layers, y,
+				     twin_screen_row (t->pixels, t->stride,
+						      y - c->top));
+    }
+}
+
+static void *
+twin_screen_worker (void *closure)
+{
+    twin_screen_worker_t    *w = closure;
+    twin_screen_threads_t   *t = w->threads;
+    /* the pool starts at generation 0, whenever this thread runs */
+    unsigned long	    seen = 0;
+
+    pthread_mutex_lock (&t->lock);
+    for (;;)
+    {
+	while (!t->quit && t->generation == seen)
+	    pthread_cond_wait (&t->start, &t->lock);
+	if (t->quit)
+	    break;
+	seen = t->generation;
+	pthread_mutex_unlock (&t->lock);
+
+	twin_screen_run_bands (t, t->layers + w->index * t->nlayers);
+
+	pthread_mutex_lock (&t->lock);
+	if (--t->busy == 0)
+	    pthread_cond_signal (&t->done);
+    }
+    pthread_mutex_unlock (&t->lock);
+    return NULL;
+}
+
+static void
+twin_screen_threads_destroy (twin_screen_threads_t *t)
+{
+    int	i;
+
+    pthread_mutex_lock (&t->lock);
+    t->quit = TWIN_TRUE;
+    pthread_cond_broadcast (&t->start);
+    pthread_mutex_unlock (&t->lock);
+    for (i = 0; i < t->nworkers; i++)
+	pthread_join (t->workers[i].thread, NULL);
+    pthread_cond_destroy (&t->done);
+    pthread_cond_destroy (&t->start);
+    pthread_mutex_destroy (&t->lock);
+    free (t->workers);
+    free (t);
+}
+
+static twin_screen_threads_t *
+twin_screen_threads_create (int nworkers)
+{
+    twin_screen_threads_t   *t = calloc (1, sizeof (twin_screen_threads_t));
+    int			    i;
+
+    if (!t)
+	return NULL;
+    t->workers = calloc (nworkers, sizeof (twin_screen_worker_t));
+    if (!t->workers)
+    {
+	free (t);
+	return NULL;
+    }
+    pthread_mutex_init (&t->lock, NULL);
+    pthread_cond_init (&t->start, NULL);
+    pthread_cond_init (&t->done, NULL);
+    for (i = 0; i < nworkers; i++)
+    {
+	t->workers[i].threads = t;
+	t->workers[i].index = i;
+	if (pthread_create (&t->workers[i].thread, NULL,
+			    twin_screen_worker, &t->workers[i]) != 0)
+	    break;
+	t->nworkers++;
+    }
+    if (!t->nworkers)
+    {
+	twin_screen_threads_destroy (t);
+	return NULL;
+    }
+    return t;
+}
+
+static void
+twin_screen_compose_threaded (twin_screen_threads_t *t,
+			      twin_screen_compose_t *c,
+			      twin_argb32_t *pixels, twin_coord_t stride)
+{
+    pthread_mutex_lock (&t->lock);
+    t->compose = c;
+    t->pixels = pixels;
+    t->stride = stride;
+    t->next_band = 0;
+    t->nbands = ((c->bottom - c->top + TWIN_SCREEN_BAND_ROWS - 1) /
+		 TWIN_SCREEN_BAND_ROWS);
+    t->busy = t->nworkers;
+    t->generation++;
+    pthread_cond_broadcast (&t->start);
+    pthread_mutex_unlock (&t->lock);
+
+    /* lend a hand */
+    twin_screen_run_bands (t, t->layers + t->nworkers * t->nlayers);
+
+    pthread_mutex_lock (&t->lock);
+    while (t->busy)
+	pthread_cond_wait (&t->done, &t->lock);
+    t->compose = NULL;
+    pthread_mutex_unlock (&t->lock);
+}
+
+#endif /* HAVE_PTHREAD */
+
 void
-twin_screen_update (twin_screen_t *screen)
+twin_screen_set_threads (twin_screen_t *screen, int nthreads)
 {
-    twin_coord_t	left = screen->damage.left;
-    twin_coord_t	top = screen->damage.top;
-    twin_coord_t	right = screen->damage.right;
-    twin_coord_t	bottom = screen->damage.bottom;
-    twin_src_op		pop16, pop32, bop32;
+#ifdef HAVE_PTHREAD
+    if (screen->threads)
+    {
+	twin_screen_threads_destroy (screen->threads);
+	screen->threads = NULL;
+    }
+    if (nthreads <= 0)
+	nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+    /* the updating thread does its share */
+    if (nthreads > 1)
+	screen->threads = twin_screen_threads_create (nthreads - 1);
+#endif
+}
 
-    pop16 = _twin_rgb16_source_argb32;
-    pop32 = _twin_argb32_over_argb32;
-    bop32 = _twin_argb32_source_argb32;
+static twin_bool_t
+twin_screen_threaded (twin_screen_t *screen, twin_screen_compose_t *c)
+{
+#ifdef HAVE_PTHREAD
+    return (screen->threads &&
+	    c->bottom - c->top > TWIN_SCREEN_BAND_ROWS &&
+	    (twin_area_t) (c->right - c->left) * (c->bottom - c->top) >=
+	    TWIN_SCREEN_THREAD_AREA);
+#else
+    return TWIN_FALSE;
+#endif
+}
+
+static void
+twin_screen_compose_rect (twin_screen_t *screen, twin_screen_compose_t *c,
+			  twin_screen_layer_t *layers,
+			  twin_argb32_t *pixels, twin_coord_t stride)
+{
+    twin_coord_t    y;
 
-#ifdef HAVE_ALTIVEC
-    if (twin_has_feature(TWIN_FEATURE_ALTIVEC)) {
-	pop32 = _twin_vec_argb32_over_argb32;
-	bop32 = _twin_vec_argb32_source_argb32;
+#ifdef HAVE_PTHREAD
+    if (twin_screen_threaded (screen, c))
+    {
+	twin_screen_compose_threaded (screen->threads, c, pixels, stride);
+	return;
     }
 #endif
+    for (y = c->top; y < c->bottom; y++)
+	twin_screen_compose_row (c, layers, y,
+				 twin_screen_row (pixels, stride, y - c->top));
+}
+
+/*
+ * Make the screen buffer large enough for the rectangle
+ */
+static twin_argb32_t *
+twin_screen_buffer (twin_screen_t *screen, twin_screen_compose_t *c)
+{
+    twin_area_t	size = (twin_area_t) (c->right - c->left) *
+			(c->bottom - c->top);
+
+    if (size > screen->buffer_size)
+    {
+	twin_argb32_t	*buffer = realloc (screen->buffer,
+					   size * sizeof (twin_argb32_t));
+	if (!buffer)
+	    return NULL;
+	screen->buffer = buffer;
+	screen->buffer_size = size;
+    }
+    return screen->buffer;
+}
+
+static void
+twin_screen_update_rect (twin_screen_t *screen, twin_argb32_t *span,
+			 twin_pixmap_t **visible, twin_screen_layer_t *layers,
+			 twin_rect_t *rect, const twin_screen_ops_t *ops)
+{
+    twin_screen_compose_t   c;
+    twin_pixmap_t	    *p;
+    twin_argb32_t	    *pixels;
+    twin_coord_t	    stride;
+    twin_coord_t	    y;
+
+    c.screen = screen;
+    c.left = rect->left;
+    c.top = rect->top;
+    c.right = rect->right;
+    c.bottom = rect->bottom;
+    c.ops = ops;
+
+    if (c.right > screen->width)
+	c.right = screen->width;
+    if (c.bottom > screen->height)
+	c.bottom = screen->height;
+    if (c.left >= c.right || c.top >= c.bottom)
+	return;
+
+    /* pixmaps touching this rectangle, topmost first */
+    c.visible = visible;
+    c.nvisible = 0;
+    for (p = screen->top; p; p = p->down)
+	if (p->x < c.right && c.left < p->x + p->width &&
+	    p->y < c.bottom && c.top < p->y + p->height)
+	    visible[c.nvisible++] = p;
+
+    /* changes are reported once the whole update is done */
+    if (screen->direct)
+    {
+	stride = screen->direct_stride;
+	pixels = twin_screen_pixel (screen, twin_screen_row (screen->direct,
+							     stride, c.top),
+				    c.left);
+	twin_screen_compose_rect (screen, &c, layers, pixels, stride);
+	return;
+    }
+
+    if (screen->put_rect)
+    {
+	pixels = NULL;
+	if (screen->get_rect)
+	    pixels = (*screen->get_rect) (c.left, c.top, c.right, c.bottom,
+					  &stride, screen->closure);
+	if (!pixels)
+	{
+	    pixels = twin_screen_buffer (screen, &c);
+	    if (!pixels)
+		return;
+	    stride = ((c.right - c.left) *
+		      twin_bytes_per_pixel (screen->format));
+	}
+	twin_screen_compose_rect (screen, &c, layers, pixels, stride);
+	(*screen->put_rect) (c.left, c.top, c.right, c.bottom,
+			     pixels, stride, screen->closure);
+	return;
+    }
+
+    if (screen->put_begin)
+	(*screen->put_begin) (c.left, c.top, c.right, c.bottom,
+			      screen->closure);
+
+    /* threads need somewhere to put all of the rows */
+    if (twin_screen_threaded (screen, &c) &&
+	(pixels = twin_screen_buffer (screen, &c)))
+    {
+	stride = ((c.right - c.left) *
+		      twin_bytes_per_pixel (screen->format));
+	twin_screen_compose_rect (screen, &c, layers, pixels, stride);
+	for (y = c.top; y < c.bottom; y++)
+	    (*screen->put_span) (c.left, y, c.right,
+				 twin_screen_row (pixels, stride, y - c.top),
+				 screen->closure);
+	return;
+    }
+
+    for (y = c.top; y < c.bottom; y++)
+    {
+	twin_screen_compose_row (&c, layers, y, span);
+	(*screen->put_span) (c.left, y, c.right, span, screen->closure);
+    }
+}
+
+/*
+ * Tell the backend which part of the direct target changed
+ */
+static void
+twin_screen_put_direct (twin_screen_t *screen, twin_rect_t *rect)
+{
+    twin_coord_t    left = rect->left;
+    twin_coord_t    top = rect->top;
+    twin_coord_t    right = rect->right;
+    twin_coord_t    bottom = rect->bottom;
+    twin_coord_t    stride = screen->direct_stride;
+    twin_argb32_t   *pixels;
+    twin_coord_t    y;
 
+    if (left < 0)
+	left = 0;
+    if (top < 0)
+	top = 0;
     if (right > screen->width)
 	right = screen->width;
     if (bottom > screen->height)
 	bottom = screen->height;
+    if (left >= right || top >= bottom)
+	return;
 
-    if (!screen->disable && left < right && top < bottom)
+    pixels = twin_screen_pixel (screen, twin_screen_row (screen->direct,
+							 stride, top),
+				left);
+    if (screen->put_rect)
+	(*screen->put_rect) (left, top, right, bottom,
+			     pixels, stride, screen->closure);
+    else if (screen->put_span)
     {
-	twin_argb32_t	*span;
-        twin_pixmap_t	*p;
-	twin_coord_t	y;
-	twin_coord_t	width = right - left;
-
-	screen->damage.left = screen->damage.right = 0;
-	screen->damage.top = screen->damage.bottom = 0;
-	/* XXX what is the maximum number of lines? */
-	span = malloc (width * sizeof (twin_argb32_t));
-	if (!span)
-	    return;
-	
 	if (screen->put_begin)
 	    (*screen->put_begin) (left, top, right, bottom, screen->closure);
 	for (y = top; y < bottom; y++)
-	{
-	    if (screen->background)
-	    {
-		twin_pointer_t  dst;
-		twin_source_u	src;
-		twin_coord_t	p_left;
-		twin_coord_t	m_left;
-		twin_coord_t	p_this;
-		twin_coord_t	p_width = screen->background->width;
-		twin_coord_t	p_y = y % screen->background->height;
-		
-		for (p_left = left; p_left < right; p_left += p_this)
-		{
-		    dst.argb32 = span + (p_left - left);
-		    m_left = p_left % p_width;
-		    p_this = p_width - m_left;
-		    if (p_left + p_this > right)
-			p_this = right - p_left;
-		    src.p = twin_pixmap_pointer (screen->background,
-						 m_left, p_y);
-		    bop32 (dst, src, p_this);
-		}
-	    }
-	    else
-		memset (span, 0xff, width * sizeof (twin_argb32_t));
+	    (*screen->put_span) (left, y, right,
+				 twin_screen_row (pixels, stride, y - top),
+				 screen->closure);
+    }
+}
 
-	    for (p = screen->bottom; p; p = p->up)
-		twin_screen_span_pixmap(screen, span, p, y, left, right,
-					pop16, pop32);
+/*
+ * Copy the pixels beneath the cursor back into the target
+ */
+static void
+twin_screen_restore_under (twin_screen_t *screen)
+{
+    twin_rect_t	    *r = &screen->under_rect;
+    size_t	    len = ((r->right - r->left) *
+			   twin_bytes_per_pixel (screen->format));
+    twin_coord_t    y;
 
-	    if (screen->cursor)
-		twin_screen_span_pixmap(screen, span, screen->cursor,
-					y, left, right, pop16, pop32);
+    for (y = r->top; y < r->bottom; y++)
+	memcpy (twin_screen_pixel (screen,
+				   twin_screen_row (screen->direct,
+						    screen->direct_stride, y),
+				   r->left),
+		(twin_a8_t *) screen->under + (twin_area_t) (y - r->top) * len,
+		len);
+    screen->cursor_drawn = TWIN_FALSE;
+}
 
-	    (*screen->put_span) (left, y, right, span, screen->closure);
+/*
+ * Save the pixels about to be covered and blend the cursor over them
+ */
+static void
+twin_screen_draw_cursor (twin_screen_t *screen,
+			 const twin_screen_ops_t *ops)
+{
+    twin_pixmap_t   *cursor = screen->cursor;
+    twin_rect_t	    *r = &screen->under_rect;
+    size_t	    len;
+    twin_argb32_t   *row;
+    twin_coord_t    y;
+
+    r->left = cursor->x < 0 ? 0 : cursor->x;
+    r->top = cursor->y < 0 ? 0 : cursor->y;
+    r->right = cursor->x + cursor->width;
+    if (r->right > screen->width)
+	r->right = screen->width;
+    r->bottom = cursor->y + cursor->height;
+    if (r->bottom > screen->height)
+	r->bottom = screen->height;
+    if (r->left >= r->right || r->top >= r->bottom)
+	return;
+
+    len = (r->right - r->left) * twin_bytes_per_pixel (screen->format);
+    if ((twin_area_t) (r->right - r->left) * (r->bottom - r->top) >
+	screen->under_size)
+    {
+	twin_area_t	size = (twin_area_t) cursor->width * cursor->height;
+	twin_argb32_t	*under = realloc (screen->under,
+					  size * sizeof (twin_argb32_t));
+	if (!under)
+	    return;
+	screen->under = under;
+	screen->under_size = size;
+    }
+
+    for (y = r->top; y < r->bottom; y++)
+    {
+	row = twin_screen_pixel (screen,
+				 twin_screen_row (screen->direct,
+						  screen->direct_stride, y),
+				 r->left);
+	memcpy ((twin_a8_t *) screen->under + (twin_area_t) (y - r->top) * len,
+		row, len);
+	twin_screen_span_pixmap (screen, row, cursor, y,
+				 r->left, r->right, ops);
+    }
+    screen->cursor_drawn = TWIN_TRUE;
+}
+
+/*
+ * Damage the part of rect outside of hole
+ */
+static void
+twin_screen_damage_outside (twin_screen_t *screen,
+			    twin_rect_t *rect, twin_rect_t *hole)
+{
+    twin_coord_t    top = hole->top > rect->top ? hole->top : rect->top;
+    twin_coord_t    bottom = (hole->bottom < rect->bottom ?
+			      hole->bottom : rect->bottom);
+
+    twin_screen_damage (screen, rect->left, rect->top, rect->right,
+			hole->top < rect->bottom ? hole->top : rect->bottom);
+    twin_screen_damage (screen, rect->left, top,
+			hole->left < rect->right ? hole->left : rect->right,
+			bottom);
+    twin_screen_damage (screen,
+			hole->right > rect->left ? hole->right : rect->left,
+			top, rect->right, bottom);
+    twin_screen_damage (screen, rect->left,
+			hole->bottom > rect->top ? hole->bottom : rect->top,
+			rect->right, rect->bottom);
+}
+
+/*
+ * Damage the part of dst showing rect, either where it is or
+ * where the copy will drag its pixels to
+ */
+static void
+twin_screen_damage_over (twin_screen_t *screen, twin_rect_t *dst,
+			 twin_rect_t *rect, twin_coord_t dx, twin_coord_t dy)
+{
+    twin_coord_t    i;
+
+    for (i = 0; i < 2; i++)
+    {
+	twin_screen_damage (screen,
+			    rect->left > dst->left ? rect->left : dst->left,
+			    rect->top > dst->top ? rect->top : dst->top,
+			    rect->right < dst->right ? rect->right : dst->right,
+			    (rect->bottom < dst->bottom ?
+			     rect->bottom : dst->bottom));
+	if (!dx && !dy)
+	    break;
+	rect->left += dx;
+	rect->top += dy;
+	rect->right += dx;
+	rect->bottom += dy;
+    }
+}
+
+/*
+ * Work out where the moved pixmap's pixels can be copied from and
+ * damage everything the copy leaves wrong: the strips it exposes,
+ * anything stacked above the pixmap, and pixels which were already
+ * stale at the source
+ */
+static twin_bool_t
+twin_screen_copy_prepare (twin_screen_t *screen, twin_rect_t *src,
+			  twin_coord_t *dxp, twin_coord_t *dyp)
+{
+    twin_pixmap_t   *pixmap = screen->move_pixmap;
+    twin_coord_t    dx = pixmap->x - screen->move_x;
+    twin_coord_t    dy = pixmap->y - screen->move_y;
+    twin_rect_t	    from, to, dst, r;
+    twin_region_t   stale;
+    twin_pixmap_t   *p;
+    int		    i;
+
+    screen->move_pixmap = NULL;
+    if (!dx && !dy)
+	return TWIN_FALSE;
+
+    from.left = screen->move_x;
+    from.top = screen->move_y;
+    from.right = from.left + pixmap->width;
+    from.bottom = from.top + pixmap->height;
+    to.left = pixmap->x;
+    to.top = pixmap->y;
+    to.right = to.left + pixmap->width;
+    to.bottom = to.top + pixmap->height;
+
+    /* the part of the old position which lands on screen */
+    dst.left = from.left < 0 ? dx : from.left + dx;
+    dst.top = from.top < 0 ? dy : from.top + dy;
+    dst.right = from.right > screen->width ? screen->width + dx : to.right;
+    dst.bottom = (from.bottom > screen->height ?
+		  screen->height + dy : to.bottom);
+    if (dst.left < 0)
+	dst.left = 0;
+    if (dst.top < 0)
+	dst.top = 0;
+    if (dst.right > screen->width)
+	dst.right = screen->width;
+    if (dst.bottom > screen->height)
+	dst.bottom = screen->height;
+    if (dst.left >= dst.right || dst.top >= dst.bottom ||
+	(!screen->direct && !screen->copy_rect))
+    {
+	twin_screen_damage (screen, from.left, from.top,
+			    from.right, from.bottom);
+	twin_screen_damage (screen, to.left, to.top, to.right, to.bottom);
+	return TWIN_FALSE;
+    }
+    src->left = dst.left - dx;
+    src->top = dst.top - dy;
+    src->right = dst.right - dx;
+    src->bottom = dst.bottom - dy;
+
+    /* pixels not yet brought up to date travel with the copy */
+    stale = screen->damage;
+    for (i = 0; i < stale.nrects; i++)
+    {
+	r = stale.rects[i];
+	twin_screen_damage_over (screen, &dst, &r, dx, dy);
+    }
+
+    /* and so do pieces of anything stacked above the pixmap */
+    for (p = pixmap->up; p; p = p->up)
+    {
+	r.left = p->x;
+	r.top = p->y;
+	r.right = p->x + p->width;
+	r.bottom = p->y + p->height;
+	twin_screen_damage_over (screen, &dst, &r, dx, dy);
+    }
+    if (screen->cursor && !twin_screen_cursor_overlaid (screen))
+    {
+	p = screen->cursor;
+	r.left = p->x;
+	r.top = p->y;
+	r.right = p->x + p->width;
+	r.bottom = p->y + p->height;
+	twin_screen_damage_over (screen, &dst, &r, dx, dy);
+    }
+
+    /* what the pixmap uncovered, and any of it newly on screen */
+    twin_screen_damage_outside (screen, &from, &dst);
+    twin_screen_damage_outside (screen, &to, &dst);
+
+    *dxp = dx;
+    *dyp = dy;
+    return TWIN_TRUE;
+}
+
+/*
+ * Shift src by dx, dy in the target
+ */
+static void
+twin_screen_copy (twin_screen_t *screen, twin_rect_t *src,
+		  twin_coord_t dx, twin_coord_t dy)
+{
+    twin_coord_t    stride = screen->direct_stride;
+    size_t	    len = ((src->right - src->left) *
+			   twin_bytes_per_pixel (screen->format));
+    twin_coord_t    y;
+
+    if (!screen->direct)
+    {
+	(*screen->copy_rect) (src->left, src->top, src->right, src->bottom,
+			      dx, dy, screen->closure);
+	return;
+    }
+    /* walk away from the destination so rows aren't overwritten */
+    for (y = 0; y < src->bottom - src->top; y++)
+    {
+	twin_coord_t	row = dy > 0 ? src->bottom - 1 - y : src->top + y;
+
+	memmove (twin_screen_pixel (screen,
+				    twin_screen_row (screen->direct, stride,
+						     row + dy),
+				    src->left + dx),
+		 twin_screen_pixel (screen,
+				    twin_screen_row (screen->direct, stride,
+						     row),
+				    src->left),
+		 len);
+    }
+}
+
+void
+twin_screen_update (twin_screen_t *screen)
+{
+    twin_region_t	damage;
+    twin_screen_ops_t	ops;
+    twin_argb32_t	*span;
+    twin_pixmap_t	**visible;
+    twin_screen_layer_t	*layers;
+    twin_pixmap_t	*p;
+    twin_coord_t	width;
+    int			npixmaps, nlayers;
+    twin_bool_t		overlay, under_drawn;
+    twin_rect_t		under_rect;
+    twin_bool_t		copy;
+    twin_rect_t		copy_src;
+    twin_coord_t	copy_dx, copy_dy;
+    int			i;
+
+    overlay = twin_screen_cursor_overlaid (screen);
+    if (screen->disable)
+	return;
+    if (twin_region_is_empty (&screen->damage) && !screen->move_pixmap &&
+	!(overlay && screen->cursor_moved))
+	return;
+
+    copy = (screen->move_pixmap &&
+	    twin_screen_copy_prepare (screen, &copy_src, &copy_dx, &copy_dy));
+
+    damage = screen->damage;
+    twin_region_init (&screen->damage);
+
+    width = 0;
+    for (i = 0; i < damage.nrects; i++)
+	if (damage.rects[i].right - damage.rects[i].left > width)
+	    width = damage.rects[i].right - damage.rects[i].left;
+
+    npixmaps = 0;
+    for (p = screen->bottom; p; p = p->up)
+	npixmaps++;
+
+    /* each composing thread needs its own layer list */
+    nlayers = npixmaps;
+#ifdef HAVE_PTHREAD
+    if (screen->threads)
+	nlayers *= screen->threads->nworkers + 1;
+#endif
+
+    layers = malloc (nlayers * sizeof (twin_screen_layer_t) +
+		     npixmaps * sizeof (twin_pixmap_t *) +
+		     width * sizeof (twin_argb32_t));
+    if (!layers)
+	return;
+    visible = (twin_pixmap_t **) (layers + nlayers);
+    span = (twin_argb32_t *) (visible + npixmaps);
+
+#ifdef HAVE_PTHREAD
+    if (screen->threads)
+    {
+	screen->threads->layers = layers;
+	screen->threads->nlayers = npixmaps;
+    }
+#endif
+
+    twin_screen_ops_init (screen, &ops);
+
+    if (screen->begin_frame)
+	(*screen->begin_frame) (screen->closure);
+
+    /* take the cursor off, recompose, then put it back */
+    under_drawn = overlay && screen->cursor_drawn;
+    under_rect = screen->under_rect;
+    if (under_drawn)
+	twin_screen_restore_under (screen);
+    if (copy)
+	twin_screen_copy (screen, &copy_src, copy_dx, copy_dy);
+    for (i = 0; i < damage.nrects; i++)
+	twin_screen_update_rect (screen, span, visible, layers,
+				 &damage.rects[i], &ops);
+    if (copy && screen->direct)
+	twin_region_union_rect (&damage,
+				copy_src.left + copy_dx, copy_src.top + copy_dy,
+				copy_src.right + copy_dx,
+				copy_src.bottom + copy_dy);
+    if (overlay)
+    {
+	if (under_drawn)
+	    twin_region_union_rect (&damage,
+				    under_rect.left, under_rect.top,
+				    under_rect.right, under_rect.bottom);
+	if (screen->cursor)
+	{
+	    twin_screen_draw_cursor (screen, &ops);
+	    if (screen->cursor_drawn)
+		twin_region_union_rect (&damage,
+					screen->under_rect.left,
+					screen->under_rect.top,
+					screen->under_rect.right,
+					screen->under_rect.bottom);
 	}
-	free (span);
+	screen->cursor_moved = TWIN_FALSE;
     }
+
+    if (screen->direct)
+	for (i = 0; i < damage.nrects; i++)
+	    twin_screen_put_direct (screen, &damage.rects[i]);
+
+    if (screen->end_frame)
+	(*screen->end_frame) (screen->closure);
+    free (layers);
 }
 
 void
@@ -284,6 +1360,9 @@ twin_screen_set_background (twin_screen_t *screen, twin_pixmap_t *pixmap)
     if (screen->background)
 	twin_pixmap_destroy (screen->background);
     screen->background = pixmap;
+    /* backgrounds have always been tiled */
+    if (pixmap && pixmap->extend == TWIN_EXTEND_NONE)
+	twin_pixmap_set_extend (pixmap, TWIN_EXTEND_REPEAT);
     twin_screen_damage (screen, 0, 0, screen->width, screen->height);
 }
 
@@ -296,6 +1375,13 @@ twin_screen_get_background (twin_screen_t *screen)
 static void
 twin_screen_damage_cursor(twin_screen_t *screen)
 {
+    if (twin_screen_cursor_overlaid (screen))
+    {
+	screen->cursor_moved = TWIN_TRUE;
+	if (!screen->disable)
+	    twin_screen_notify_damaged (screen);
+	return;
+    }
     twin_screen_damage (screen,
 			screen->cursor->x,
 			screen->cursor->y,
@@ -303,6 +1389,30 @@ twin_screen_damage_cursor(twin_screen_t *screen)
 			screen->cursor->y + screen->cursor->height);
 }
 
+void
+twin_screen_set_cursor_overlay (twin_screen_t *screen, twin_bool_t overlay)
+{
+    if (screen->cursor_overlay == overlay)
+	return;
+    twin_screen_disable_update (screen);
+    if (screen->cursor_drawn)
+    {
+	twin_screen_damage (screen,
+			    screen->under_rect.left, screen->under_rect.top,
+			    screen->under_rect.right, screen->under_rect.bottom);
+	screen->cursor_drawn = TWIN_FALSE;
+    }
+    screen->cursor_overlay = overlay;
+    screen->cursor_moved = TWIN_FALSE;
+    if (screen->cursor)
+	twin_screen_damage (screen,
+			    screen->cursor->x,
+			    screen->cursor->y,
+			    screen->cursor->x + screen->cursor->width,
+			    screen->cursor->y + screen->cursor->height);
+    twin_screen_enable_update (screen);
+}
+
 void
 twin_screen_set_cursor (twin_screen_t *screen, twin_pixmap_t *pixmap,
 			twin_fixed_t hotspot_x, twin_fixed_t hotspot_y)
@@ -379,11 +1489,8 @@ twin_bool_t twin_screen_dispatch (twin_screen_t *screen,
 	    screen->clicklock = 0;
 
 	/* check who the mouse is over now */
-	for (ntarget = screen->top; ntarget; ntarget = ntarget->down)
-	    if (!twin_pixmap_transparent (ntarget,
-					  event->u.pointer.screen_x,
-					  event->u.pointer.screen_y))
-		break;
+	ntarget = _twin_grid_lookup (screen, event->u.pointer.screen_x,
+				     event->u.pointer.screen_y);
 
 	/* ah, somebody new ... send leave/enter events and set new target */
 	if (pixmap != ntarget) {
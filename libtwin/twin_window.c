@@ -130,6 +130,7 @@ twin_window_configure (twin_window_t	    *window,
 	int		i;
 
 	window->pixmap = twin_pixmap_create (old->format, width, height);
+	window->pixmap->opaque = old->opaque;
 	window->pixmap->window = window;
 	twin_pixmap_move (window->pixmap, x, y);
 	if (old->screen)
@@ -22,61 +22,134 @@
 #include "twin_x11.h"
 #include "twinint.h"
 
-static void
-_twin_x11_put_begin (twin_coord_t   left,
-		     twin_coord_t   top,
-		     twin_coord_t   right,
-		     twin_coord_t   bottom,
-		     void	    *closure)
+/* Update the screen at most this often (ms) */
+#define TWIN_X11_FRAME_INTERVAL	(1000 / 60)
+
+static XImage *
+_twin_x11_create_image (twin_x11_t *tx, twin_coord_t width, twin_coord_t height)
 {
-    twin_x11_t	    *tx = closure;
-    twin_coord_t    width = right - left;
-    twin_coord_t    height = bottom - top;
+    XImage  *image;
 
-    tx->image_y = top;
-    tx->image = XCreateImage (tx->dpy, tx->visual, tx->depth, ZPixmap,
-			      0, 0, width, height, 32, 0);
-    if (tx->image)
+    image = XCreateImage (tx->dpy, tx->visual, tx->depth, ZPixmap,
+			  0, 0, width, height, 32, 0);
+    if (image)
     {
-	tx->image->data = malloc (4 * width * height);
-	if (!tx->image->data)
+	image->data = malloc (image->bytes_per_line * height);
+	if (!image->data)
 	{
-	    XDestroyImage (tx->image);
-	    tx->image = 0;
+	    XDestroyImage (image);
+	    image = 0;
 	}
     }
+    return image;
+}
+
+/*
+ * When the visual holds pixels just like twin does, compose
+ * straight into the image
+ */
+static twin_argb32_t *
+_twin_x11_get_rect (twin_coord_t    left,
+		    twin_coord_t    top,
+		    twin_coord_t    right,
+		    twin_coord_t    bottom,
+		    twin_coord_t    *stride,
+		    void	    *closure)
+{
+    twin_x11_t	    *tx = closure;
+    static const int	one = 1;
+
+    tx->image = 0;
+    if (twin_screen_get_format (tx->screen) != TWIN_ARGB32 ||
+	tx->visual->red_mask != 0xff0000 ||
+	tx->visual->green_mask != 0x00ff00 ||
+	tx->visual->blue_mask != 0x0000ff)
+	return 0;
+    tx->image = _twin_x11_create_image (tx, right - left, bottom - top);
+    if (!tx->image)
+	return 0;
+    if (tx->image->bits_per_pixel != 32)
+    {
+	XDestroyImage (tx->image);
+	tx->image = 0;
+	return 0;
+    }
+    /* Xlib swaps to the server order as needed */
+    tx->image->byte_order = *(char *) &one ? LSBFirst : MSBFirst;
+    *stride = tx->image->bytes_per_line;
+    return (twin_argb32_t *) tx->image->data;
 }
 
 static void
-_twin_x11_put_span (twin_coord_t    left,
+_twin_x11_put_rect (twin_coord_t    left,
 		    twin_coord_t    top,
 		    twin_coord_t    right,
+		    twin_coord_t    bottom,
 		    twin_argb32_t   *pixels,
+		    twin_coord_t    stride,
 		    void	    *closure)
 {
     twin_x11_t	    *tx = closure;
     twin_coord_t    width = right - left;
-    twin_coord_t    ix;
-    twin_coord_t    iy = top - tx->image_y;
+    twin_coord_t    height = bottom - top;
+    twin_bool_t	    rgb16;
+    twin_coord_t    ix, iy;
 
     if (!tx->image)
-	return;
-
-    for (ix = 0; ix < width; ix++)
-    {
-	twin_argb32_t	pixel = *pixels++;
-	
-	if (tx->depth == 16)
-	    pixel = twin_argb32_to_rgb16 (pixel);
-	XPutPixel (tx->image, ix, iy, pixel);
-    }
-    if ((top + 1 - tx->image_y) == tx->image->height)
     {
-	XPutImage (tx->dpy, tx->win, tx->gc, tx->image, 0, 0, 
-		   left, tx->image_y, tx->image->width, tx->image->height);
-	XDestroyImage (tx->image);
-	tx->image = 0;
+	tx->image = _twin_x11_create_image (tx, width, height);
+	if (!tx->image)
+	    return;
+	rgb16 = twin_screen_get_format (tx->screen) == TWIN_RGB16;
+	for (iy = 0; iy < height; iy++)
+	{
+	    twin_pointer_t  p;
+
+	    p.v = (char *) pixels + iy * stride;
+	    for (ix = 0; ix < width; ix++)
+	    {
+		twin_argb32_t	pixel;
+
+		/* pixels come in the screen format */
+		if (rgb16)
+		{
+		    pixel = *p.rgb16++;
+		    if (tx->depth != 16)
+			pixel = twin_rgb16_to_argb32 (pixel);
+		}
+		else
+		{
+		    pixel = *p.argb32++;
+		    if (tx->depth == 16)
+			pixel = twin_argb32_to_rgb16 (pixel);
+		}
+		XPutPixel (tx->image, ix, iy, pixel);
+	    }
+	}
     }
+    XPutImage (tx->dpy, tx->win, tx->gc, tx->image, 0, 0,
+	       left, top, width, height);
+    XDestroyImage (tx->image);
+    tx->image = 0;
+}
+
+/*
+ * Parts of the window which couldn't be copied come
+ * back as GraphicsExpose events
+ */
+static void
+_twin_x11_copy_rect (twin_coord_t   left,
+		     twin_coord_t   top,
+		     twin_coord_t   right,
+		     twin_coord_t   bottom,
+		     twin_coord_t   dx,
+		     twin_coord_t   dy,
+		     void	    *closure)
+{
+    twin_x11_t	    *tx = closure;
+
+    XCopyArea (tx->dpy, tx->win, tx->win, tx->gc, left, top,
+	       right - left, bottom - top, left + dx, top + dy);
 }
 
 static twin_bool_t
@@ -96,6 +169,12 @@ twin_x11_read_events (int		file,
 	case Expose:
 	    twin_x11_damage (tx, (XExposeEvent *) &ev);
 	    break;
+	case GraphicsExpose:
+	    twin_screen_damage (tx->screen, ev.xgraphicsexpose.x,
+				ev.xgraphicsexpose.y,
+				ev.xgraphicsexpose.x + ev.xgraphicsexpose.width,
+				ev.xgraphicsexpose.y + ev.xgraphicsexpose.height);
+	    break;
 	case DestroyNotify:
 	    return 0;
 	case ButtonPress:
@@ -120,17 +199,12 @@ twin_x11_read_events (int		file,
     return TWIN_TRUE;
 }
 
-static twin_bool_t
-twin_x11_work (void *closure)
+static void
+_twin_x11_end_frame (void *closure)
 {
     twin_x11_t		    *tx = closure;
-    
-    if (twin_screen_damaged (tx->screen))
-    {
-	twin_x11_update (tx);
-	XFlush (tx->dpy);
-    }
-    return TWIN_TRUE;
+
+    XFlush (tx->dpy);
 }
 
 twin_x11_t *
@@ -158,8 +232,6 @@ twin_x11_create (Display *dpy, int width, int height)
 		      ConnectionNumber (dpy),
 		      TWIN_READ,
 		      tx);
-    
-    twin_set_work (twin_x11_work, TWIN_WORK_REDISPLAY, tx);
 
     wa.background_pixmap = None;
     wa.event_mask = (KeyPressMask|
@@ -192,8 +264,14 @@ twin_x11_create (Display *dpy, int width, int height)
     XSetWMProtocols (dpy, tx->win, &wm_delete_window, 1);
 
     tx->gc = XCreateGC (dpy, tx->win, 0, 0);
-    tx->screen = twin_screen_create (width, height, _twin_x11_put_begin,
-				     _twin_x11_put_span, tx);
+    tx->image = 0;
+    tx->image_y = 0;
+    tx->screen = twin_screen_create (width, height, NULL, NULL, tx);
+    twin_screen_set_put_rect (tx->screen, _twin_x11_get_rect,
+			      _twin_x11_put_rect);
+    twin_screen_set_put_frame (tx->screen, NULL, _twin_x11_end_frame);
+    twin_screen_set_copy_rect (tx->screen, _twin_x11_copy_rect);
+    twin_screen_set_frame_interval (tx->screen, TWIN_X11_FRAME_INTERVAL);
 
     XMapWindow (dpy, tx->win);
 
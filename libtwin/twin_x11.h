@@ -36,7 +36,7 @@ typedef struct _twin_x11 {
     Visual	    *visual;
     int		    depth;
     XImage	    *image;
-    int		    image_y;
+    int		    image_y;	/* unused, kept for existing callers */
 } twin_x11_t;
 
 /*
@@ -110,6 +110,32 @@ typedef void (*twin_src_op) (twin_pointer_t dst,
 			     twin_source_u  src,
 			     int	    width);
 
+/*
+ * Shape of a source transform, picking how spans are read
+ */
+typedef enum _twin_xform_kind {
+    TWIN_XFORM_TRANSLATE,	/* whole pixel offset */
+    TWIN_XFORM_SCALE,		/* whole pixel steps along each axis */
+    TWIN_XFORM_AXIS,		/* axis aligned scale */
+    TWIN_XFORM_AFFINE
+} twin_xform_kind_t;
+
+/*
+ * Fetch width bilinear samples of pix, starting at (sx, sy) and
+ * stepping by (ux, uy); rgb16 sources are widened to argb32
+ */
+typedef void twin_bilinear_func (twin_pointer_t	dst,
+				 twin_pixmap_t	*pix,
+				 twin_fixed_t	sx,
+				 twin_fixed_t	sy,
+				 twin_fixed_t	ux,
+				 twin_fixed_t	uy,
+				 twin_coord_t	width);
+
+twin_bilinear_func _twin_a8_bilinear;
+twin_bilinear_func _twin_rgb16_bilinear;
+twin_bilinear_func _twin_argb32_bilinear;
+
 typedef struct _twin_xform {
     twin_pixmap_t	*pixmap;
     twin_pointer_t	span;
@@ -117,6 +143,7 @@ typedef struct _twin_xform {
     twin_coord_t	width;
     twin_coord_t	src_x;
     twin_coord_t	src_y;
+    twin_xform_kind_t	kind;
 } twin_xform_t;
 
 /* twin_primitive.c */
@@ -276,9 +303,99 @@ twin_op_func _twin_rgb16_source_a8;
 twin_op_func _twin_a8_source_a8;
 twin_op_func _twin_c_source_a8;
 
+twin_op_func _twin_vext_argb32_over_argb32;
+twin_op_func _twin_vext_rgb16_over_argb32;
+twin_op_func _twin_vext_a8_over_argb32;
+twin_op_func _twin_vext_c_over_argb32;
+twin_op_func _twin_vext_argb32_over_rgb16;
+twin_op_func _twin_vext_rgb16_over_rgb16;
+twin_op_func _twin_vext_a8_over_rgb16;
+twin_op_func _twin_vext_c_over_rgb16;
+twin_op_func _twin_vext_argb32_over_a8;
+twin_op_func _twin_vext_rgb16_over_a8;
+twin_op_func _twin_vext_a8_over_a8;
+twin_op_func _twin_vext_c_over_a8;
+
+twin_in_op_func _twin_vext_argb32_in_argb32_over_argb32;
+twin_in_op_func _twin_vext_argb32_in_rgb16_over_argb32;
+twin_in_op_func _twin_vext_argb32_in_a8_over_argb32;
+twin_in_op_func _twin_vext_argb32_in_c_over_argb32;
+twin_in_op_func _twin_vext_rgb16_in_argb32_over_argb32;
+twin_in_op_func _twin_vext_rgb16_in_rgb16_over_argb32;
+twin_in_op_func _twin_vext_rgb16_in_a8_over_argb32;
+twin_in_op_func _twin_vext_rgb16_in_c_over_argb32;
+twin_in_op_func _twin_vext_a8_in_argb32_over_argb32;
+twin_in_op_func _twin_vext_a8_in_rgb16_over_argb32;
+twin_in_op_func _twin_vext_a8_in_a8_over_argb32;
+twin_in_op_func _twin_vext_a8_in_c_over_argb32;
+twin_in_op_func _twin_vext_c_in_argb32_over_argb32;
+twin_in_op_func _twin_vext_c_in_rgb16_over_argb32;
+twin_in_op_func _twin_vext_c_in_a8_over_argb32;
+twin_in_op_func _twin_vext_c_in_c_over_argb32;
+twin_in_op_func _twin_vext_argb32_in_argb32_over_rgb16;
+twin_in_op_func _twin_vext_argb32_in_rgb16_over_rgb16;
+twin_in_op_func _twin_vext_argb32_in_a8_over_rgb16;
+twin_in_op_func _twin_vext_argb32_in_c_over_rgb16;
+twin_in_op_func _twin_vext_rgb16_in_argb32_over_rgb16;
+twin_in_op_func _twin_vext_rgb16_in_rgb16_over_rgb16;
+twin_in_op_func _twin_vext_rgb16_in_a8_over_rgb16;
+twin_in_op_func _twin_vext_rgb16_in_c_over_rgb16;
+twin_in_op_func _twin_vext_a8_in_argb32_over_rgb16;
+twin_in_op_func _twin_vext_a8_in_rgb16_over_rgb16;
+twin_in_op_func _twin_vext_a8_in_a8_over_rgb16;
+twin_in_op_func _twin_vext_a8_in_c_over_rgb16;
+twin_in_op_func _twin_vext_c_in_argb32_over_rgb16;
+twin_in_op_func _twin_vext_c_in_rgb16_over_rgb16;
+twin_in_op_func _twin_vext_c_in_a8_over_rgb16;
+twin_in_op_func _twin_vext_c_in_c_over_rgb16;
+twin_in_op_func _twin_vext_argb32_in_argb32_over_a8;
+twin_in_op_func _twin_vext_argb32_in_rgb16_over_a8;
+twin_in_op_func _twin_vext_argb32_in_a8_over_a8;
+twin_in_op_func _twin_vext_argb32_in_c_over_a8;
+twin_in_op_func _twin_vext_rgb16_in_argb32_over_a8;
+twin_in_op_func _twin_vext_rgb16_in_rgb16_over_a8;
+twin_in_op_func _twin_vext_rgb16_in_a8_over_a8;
+twin_in_op_func _twin_vext_rgb16_in_c_over_a8;
+twin_in_op_func _twin_vext_a8_in_argb32_over_a8;
+twin_in_op_func _twin_vext_a8_in_rgb16_over_a8;
+twin_in_op_func _twin_vext_a8_in_a8_over_a8;
+twin_in_op_func _twin_vext_a8_in_c_over_a8;
+twin_in_op_func _twin_vext_c_in_argb32_over_a8;
+twin_in_op_func _twin_vext_c_in_rgb16_over_a8;
+twin_in_op_func _twin_vext_c_in_a8_over_a8;
+twin_in_op_func _twin_vext_c_in_c_over_a8;
+
 twin_op_func _twin_vec_argb32_over_argb32;
 twin_op_func _twin_vec_argb32_source_argb32;
 
+twin_op_func _twin_sse2_argb32_over_argb32;
+twin_op_func _twin_sse2_argb32_source_argb32;
+twin_op_func _twin_sse2_rgb16_source_argb32;
+twin_op_func _twin_sse2_argb32_over_rgb16;
+twin_op_func _twin_sse2_argb32_source_rgb16;
+twin_op_func _twin_sse2_rgb16_source_rgb16;
+twin_op_func _twin_sse2_c_over_argb32;
+twin_op_func _twin_sse2_c_source_argb32;
+twin_op_func _twin_sse2_c_over_rgb16;
+twin_op_func _twin_sse2_c_source_rgb16;
+
+twin_op_func _twin_avx2_argb32_over_argb32;
+twin_op_func _twin_avx2_rgb16_source_argb32;
+twin_op_func _twin_avx2_argb32_over_rgb16;
+
+twin_in_op_func _twin_sse2_c_in_a8_over_argb32;
+twin_in_op_func _twin_sse2_c_in_a8_over_rgb16;
+twin_in_op_func _twin_sse2_c_in_a8_over_a8;
+
+twin_in_op_func _twin_avx2_c_in_a8_over_argb32;
+twin_in_op_func _twin_avx2_c_in_a8_over_rgb16;
+twin_in_op_func _twin_avx2_c_in_a8_over_a8;
+
+twin_bilinear_func _twin_sse2_argb32_bilinear;
+twin_bilinear_func _twin_sse2_rgb16_bilinear;
+twin_bilinear_func _twin_avx2_argb32_bilinear;
+twin_bilinear_func _twin_avx2_rgb16_bilinear;
+
 twin_argb32_t *
 _twin_fetch_rgb16 (twin_pixmap_t *pixmap, int x, int y, int w, twin_argb32_t *span);
 
@@ -365,6 +482,47 @@ _twin_path_scurve (twin_path_t	    *path,
 void
 _twin_path_sfinish (twin_path_t *path);
 
+/*
+ * The columns touched on each row of a mask
+ */
+typedef struct _twin_extent {
+    twin_coord_t    left, right;
+} twin_extent_t;
+
+/*
+ * Called as the rasterizer finishes each row of a mask
+ */
+typedef void (*twin_row_func_t) (twin_coord_t y, void *closure);
+
+void
+_twin_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
+		 twin_coord_t dx, twin_coord_t dy, twin_extent_t *rows,
+		 twin_row_func_t row_done, void *closure);
+
+twin_bool_t
+_twin_area_fill_path (twin_pixmap_t *pixmap, twin_path_t *path,
+		      twin_coord_t dx, twin_coord_t dy, twin_extent_t *rows,
+		      twin_row_func_t row_done, void *closure);
+
+twin_bool_t
+_twin_rect_composite_path (twin_pixmap_t	*dst,
+			   twin_operand_t	*src,
+			   twin_coord_t		src_x,
+			   twin_coord_t		src_y,
+			   twin_path_t		*path,
+			   twin_rect_t		*bounds);
+
+/*
+ * Scratch buffers, one of each slot per thread
+ */
+#define TWIN_SCRATCH_SRC	0
+#define TWIN_SCRATCH_MSK	1
+#define TWIN_SCRATCH_PATH	2
+#define TWIN_SCRATCH_SLOTS	3
+
+void *
+_twin_scratch_alloc (int slot, size_t size);
+
 /*
  * Draw stuff
  */
@@ -372,6 +530,33 @@ _twin_path_sfinish (twin_path_t *path);
 void
 _twin_draw_set_features(void);
 
+twin_src_op
+_twin_draw_op (twin_operator_t operator, twin_format_t src, twin_format_t dst);
+
+/* extend modes only apply to pixmaps with something in the clip */
+#define _twin_pixmap_extends(p) ((p)->extend != TWIN_EXTEND_NONE && \
+				 (p)->clip.left < (p)->clip.right && \
+				 (p)->clip.top < (p)->clip.bottom)
+
+void
+_twin_pixmap_read (twin_pixmap_t *pixmap, twin_coord_t x, twin_coord_t y,
+		   twin_coord_t width, twin_pointer_t span);
+
+twin_pointer_t
+_twin_pixmap_span (twin_pixmap_t *pixmap, twin_coord_t x, twin_coord_t y,
+		   twin_coord_t width, int slot);
+
+void
+_twin_composite_span (twin_pixmap_t	    *dst,
+		      twin_coord_t	    dst_x,
+		      twin_coord_t	    dst_y,
+		      twin_operand_t	    *src,
+		      twin_coord_t	    src_x,
+		      twin_coord_t	    src_y,
+		      const twin_a8_t	    *cover,
+		      twin_operator_t	    operator,
+		      twin_coord_t	    width);
+
 /*
  * Glyph stuff.  Coordinates are stored in 2.6 fixed point format
  */
@@ -469,6 +654,49 @@ _twin_timeout_delay (void);
 void
 _twin_run_work (void);
 
+/*
+ * Set up a pixmap header around pixels stored elsewhere
+ */
+void
+_twin_pixmap_init (twin_pixmap_t    *pixmap,
+		   twin_format_t    format,
+		   twin_coord_t	    width,
+		   twin_coord_t	    height,
+		   twin_coord_t	    stride,
+		   twin_pointer_t   pixels);
+
+/*
+ * Pixmap moves
+ */
+
+twin_bool_t
+_twin_screen_copy_pixmap (twin_screen_t *screen, twin_pixmap_t *pixmap);
+
+void
+_twin_screen_drop_copy (twin_screen_t *screen, twin_pixmap_t *pixmap);
+
+/*
+ * Pixmap index
+ */
+
+void
+_twin_grid_insert (twin_screen_t *screen, twin_pixmap_t *pixmap);
+
+void
+_twin_grid_remove (twin_screen_t *screen, twin_pixmap_t *pixmap);
+
+void
+_twin_grid_restack (twin_screen_t *screen);
+
+void
+_twin_grid_resize (twin_screen_t *screen);
+
+void
+_twin_grid_fini (twin_screen_t *screen);
+
+twin_pixmap_t *
+_twin_grid_lookup (twin_screen_t *screen, twin_coord_t x, twin_coord_t y);
+
 void
 _twin_box_init (twin_box_t		*box,
 		twin_box_t		*parent,